@@ -0,0 +1,125 @@
+#include "arena.h"
+#include <assert.h>
+#include <stdalign.h>
+#include <stddef.h>
+#include <string.h>
+
+#define INITIAL_BLOCK_SIZE 65536
+#define MAX_BLOCK_SIZE (16 * 1024 * 1024)
+#define ARENA_ALIGN alignof(max_align_t)
+
+struct arena_block {
+	struct arena_block *next;
+	size_t size;
+	size_t used;
+	alignas(ARENA_ALIGN) char data[];
+};
+
+struct arena_cleanup {
+	struct arena_cleanup *next;
+	arena_cleanup_func func;
+	void *data;
+};
+
+static struct arena_block *block_create(size_t size, struct arena_block *next)
+{
+	struct arena_block *block = malloc(sizeof(*block) + size);
+	assert(block != NULL);
+
+	block->next = next;
+	block->size = size;
+	block->used = 0;
+	return block;
+}
+
+struct arena *arena_create()
+{
+	struct arena *arena = malloc(sizeof(*arena));
+	assert(arena != NULL);
+
+	arena->head = block_create(INITIAL_BLOCK_SIZE, NULL);
+	arena->block_size = INITIAL_BLOCK_SIZE;
+	arena->cleanups = NULL;
+	return arena;
+}
+
+void *arena_alloc(struct arena *arena, size_t size)
+{
+	size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+	struct arena_block *block = arena->head;
+	if (block->size - block->used < size) {
+		// Blocks grow with the program so big scripts need few of them
+		if (arena->block_size < MAX_BLOCK_SIZE) {
+			arena->block_size *= 2;
+		}
+		size_t block_size =
+			size > arena->block_size ? size : arena->block_size;
+		block = block_create(block_size, arena->head);
+		arena->head = block;
+	}
+
+	void *ptr = block->data + block->used;
+	block->used += size;
+	return ptr;
+}
+
+char *arena_strndup(struct arena *arena, const char *str, size_t len)
+{
+	char *copy = arena_alloc(arena, len + 1);
+	memcpy(copy, str, len);
+	copy[len] = '\0';
+	return copy;
+}
+
+void arena_defer(struct arena *arena, arena_cleanup_func func, void *data)
+{
+	struct arena_cleanup *cleanup = arena_alloc(arena, sizeof(*cleanup));
+	cleanup->next = arena->cleanups;
+	cleanup->func = func;
+	cleanup->data = data;
+	arena->cleanups = cleanup;
+}
+
+// Cleanups live in the arena too, so they run before any block is freed
+static void run_cleanups(struct arena *arena, struct arena_cleanup *until)
+{
+	while (arena->cleanups != until) {
+		struct arena_cleanup *cleanup = arena->cleanups;
+		arena->cleanups = cleanup->next;
+		cleanup->func(cleanup->data);
+	}
+}
+
+struct arena_mark arena_get_mark(const struct arena *arena)
+{
+	return (struct arena_mark){ .block = arena->head,
+				    .used = arena->head->used,
+				    .cleanups = arena->cleanups };
+}
+
+void arena_reset(struct arena *arena, struct arena_mark mark)
+{
+	run_cleanups(arena, mark.cleanups);
+	while (arena->head != mark.block) {
+		struct arena_block *next = arena->head->next;
+		free(arena->head);
+		arena->head = next;
+	}
+	arena->head->used = mark.used;
+}
+
+void arena_destroy(struct arena *arena)
+{
+	if (!arena)
+		return;
+
+	run_cleanups(arena, NULL);
+	struct arena_block *block = arena->head;
+	while (block) {
+		struct arena_block *next = block->next;
+		free(block);
+		block = next;
+	}
+	free(arena);
+}
@@ -0,0 +1,43 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdlib.h>
+
+/*
+ * Bump allocator for everything that lives as long as a parsed program:
+ * token values, AST nodes and their argument arrays. Allocations are never
+ * freed one by one, arena_destroy releases all of them at once and
+ * arena_reset everything after a mark. Resources the arena memory refers to
+ * are released by cleanups, which run newest first when their allocation
+ * goes away.
+ */
+
+struct arena_block;
+struct arena_cleanup;
+
+typedef void (*arena_cleanup_func)(void *data);
+
+struct arena {
+	struct arena_block *head; // Block that is currently bumped
+	size_t block_size; // Size of the next block to allocate
+	struct arena_cleanup *cleanups; // Newest first
+};
+
+// Point in an arena that later allocations can be released back to
+struct arena_mark {
+	struct arena_block *block;
+	size_t used;
+	struct arena_cleanup *cleanups;
+};
+
+struct arena *arena_create();
+void *arena_alloc(struct arena *arena, size_t size);
+char *arena_strndup(struct arena *arena, const char *str, size_t len);
+// func(data) runs when everything allocated up to now is released
+void arena_defer(struct arena *arena, arena_cleanup_func func, void *data);
+struct arena_mark arena_get_mark(const struct arena *arena);
+// Releases everything allocated after mark was taken
+void arena_reset(struct arena *arena, struct arena_mark mark);
+void arena_destroy(struct arena *arena);
+
+#endif
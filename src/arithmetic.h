@@ -0,0 +1,65 @@
+#ifndef ARITHMETIC_H
+#define ARITHMETIC_H
+
+#include <stdbool.h>
+#include <limits.h>
+#include "value.h"
+
+/*
+ * Arithmetic shared by every engine so they agree on the result of each
+ * operation. Integer arithmetic wraps around instead of being undefined on
+ * overflow, and an int operand is promoted to double when the other operand
+ * is a double. Callers check for an integer division by zero themselves.
+ */
+
+static inline bool arith_is_num(struct value x)
+{
+	return value_is_num(x);
+}
+
+static inline bool arith_is_int(struct value x, struct value y)
+{
+	return value_both_int(x, y);
+}
+
+static inline double arith_to_double(struct value x)
+{
+	return value_is_int(x) ? (double)value_as_int(x) : value_as_double(x);
+}
+
+/*
+ * Converts a double assigned to an int variable. NaN and values out of the
+ * int range become INT_MIN, as cvttsd2si does, instead of being undefined.
+ */
+static inline int arith_to_int(double x)
+{
+	if (!(x > -2147483649.0 && x < 2147483648.0)) {
+		return INT_MIN;
+	}
+	return (int)x;
+}
+
+static inline int arith_int_add(int x, int y)
+{
+	return (int)((unsigned int)x + (unsigned int)y);
+}
+
+static inline int arith_int_sub(int x, int y)
+{
+	return (int)((unsigned int)x - (unsigned int)y);
+}
+
+static inline int arith_int_mul(int x, int y)
+{
+	return (int)((unsigned int)x * (unsigned int)y);
+}
+
+static inline int arith_int_div(int x, int y)
+{
+	if (y == -1) {
+		return (int)(0u - (unsigned int)x);
+	}
+	return x / y;
+}
+
+#endif
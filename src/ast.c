@@ -1,19 +1,52 @@
 #include "ast.h"
+#include "arena.h"
+#include "string_heap.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdbool.h>
+#include <assert.h>
 
-struct ast_node *ast_node_create(struct token tok)
+static void release_string(void *str)
 {
-	struct ast_node *node = malloc(sizeof(*node));
-	if (!node)
-		return NULL;
+	string_release(str);
+}
+
+struct ast_node *ast_node_create(struct arena *arena, struct token tok,
+				 struct source_pos pos, const char *text)
+{
+	struct ast_node *node = arena_alloc(arena, sizeof(*node));
 
 	node->tok = tok;
-	node->args = NULL;
+	node->pos = pos;
+	node->text = text;
+	node->str = NULL;
+	node->result = value_int(0);
+	node->type = VALUE_ANY;
+	node->func = NULL;
+	node->slot = 0;
+	node->arena = arena;
 	node->argc = 0;
 	node->parent = NULL;
 
+	// The node holds a reference until its arena releases it
+	node->string = NULL;
+	if (tok.type == TOKEN_IDENTIFIER || tok.type == TOKEN_STR) {
+		node->string = string_intern(text, tok.length);
+		arena_defer(arena, release_string, node->string);
+	}
+
+	// Commands know their argument count, only the root has to grow
+	node->capacity = 0;
+	if (tok.type == TOKEN_COMMAND || tok.type == TOKEN_SUBCOMMAND) {
+		node->func = tok.command->func;
+		node->capacity = tok.command->max_argc;
+	}
+	node->args = NULL;
+	if (node->capacity > 0)
+		node->args = arena_alloc(
+			arena, sizeof(struct ast_node *) * node->capacity);
+
 	return node;
 }
 
@@ -22,12 +55,18 @@ void ast_add_arg(struct ast_node *node, struct ast_node *arg)
 	if (!node || !arg)
 		return;
 
-	struct ast_node **new_args = realloc(
-		node->args, sizeof(struct ast_node *) * (node->argc + 1));
-	if (!new_args)
-		return;
+	if (node->argc == node->capacity) {
+		// The old array stays in the arena until it is destroyed
+		size_t capacity = node->capacity > 0 ? node->capacity * 2 : 8;
+		struct ast_node **new_args = arena_alloc(
+			node->arena, sizeof(struct ast_node *) * capacity);
+		if (node->argc > 0)
+			memcpy(new_args, node->args,
+			       sizeof(struct ast_node *) * node->argc);
+		node->args = new_args;
+		node->capacity = capacity;
+	}
 
-	node->args = new_args;
 	node->args[node->argc] = arg;
 	++node->argc;
 	arg->parent = node;
@@ -54,60 +93,132 @@ void ast_delete_node(struct ast_node *node)
 	}
 
 	parent->argc--;
-	if (parent->argc == 0) {
-		free(parent->args);
-		parent->args = NULL;
-	} else {
-		struct ast_node **new_args = realloc(
-			parent->args, sizeof(struct ast_node *) * parent->argc);
-		if (new_args)
-			parent->args = new_args;
-	}
-
-	ast_free(node);
+	node->parent = NULL; // The memory is released with the arena
 }
 
-static void ast_print_impl(const struct ast_node *const node, int level,
-			   bool last)
+/*
+ * Text of the node as written, leading dot numbers get a 0 in front. It is
+ * kept on the node, printing the same literal again allocates nothing.
+ */
+const char *ast_node_str(struct ast_node *node)
 {
-	if (!node)
-		return;
+	if (node->string)
+		return node->string->data;
+	if (node->str)
+		return node->str;
+
+	size_t len = node->tok.length;
+	bool leading_dot = len > 0 && node->text[0] == '.';
+	char *str = arena_alloc(node->arena, len + leading_dot + 1);
+	str[0] = '0';
+	memcpy(str + leading_dot, node->text, len);
+	str[len + leading_dot] = '\0';
+	node->str = str;
+	return str;
+}
 
-	// Print the tree structure
-	for (int i = 0; i < level - 1; ++i) {
-		printf("│   ");
-	}
+struct ast_walk_frame {
+	struct ast_node *node;
+	size_t next; // Index of the next child to visit
+};
 
-	if (level > 0) {
-		if (last) {
-			printf("└── ");
-		} else {
-			printf("├── ");
-		}
+#define INITIAL_WALK_SIZE 16
+
+static void walk_push(struct ast_walk *walk, struct ast_node *node)
+{
+	if (walk->length == walk->capacity) {
+		walk->capacity *= 2;
+		walk->frames = realloc(walk->frames,
+				       sizeof(*walk->frames) * walk->capacity);
+		assert(walk->frames != NULL);
 	}
 
-	// Print the node value
-	printf("%s\n", node->tok.value ? node->tok.value : "NULL");
+	walk->frames[walk->length++] =
+		(struct ast_walk_frame){ .node = node, .next = 0 };
+}
+
+void ast_walk_init(struct ast_walk *walk, struct ast_node *root)
+{
+	walk->frames = malloc(sizeof(*walk->frames) * INITIAL_WALK_SIZE);
+	assert(walk->frames != NULL);
+	walk->capacity = INITIAL_WALK_SIZE;
+	walk->length = 0;
+	walk_push(walk, root);
+}
+
+struct ast_node *ast_walk_next(struct ast_walk *walk)
+{
+	while (walk->length > 0) {
+		struct ast_walk_frame *top = &walk->frames[walk->length - 1];
+		if (top->next < top->node->argc) {
+			walk_push(walk, top->node->args[top->next++]);
+			continue;
+		}
 
-	// Recursively print children nodes
-	for (size_t i = 0; i < node->argc; ++i) {
-		ast_print_impl(node->args[i], level + 1, i == node->argc - 1);
+		--walk->length;
+		return top->node;
 	}
+	return NULL;
 }
 
-void ast_print(const struct ast_node *const root)
+void ast_walk_free(struct ast_walk *walk)
 {
-	ast_print_impl(root, 0, true);
+	free(walk->frames);
 }
 
-void ast_free(struct ast_node *node)
+struct print_frame {
+	const struct ast_node *node;
+	int level;
+	bool last;
+};
+
+void ast_print(const struct ast_node *const root)
 {
-	if (!node)
+	if (!root)
 		return;
 
-	for (size_t i = 0; i < node->argc; ++i) {
-		ast_free(node->args[i]);
+	size_t capacity = INITIAL_WALK_SIZE;
+	size_t length = 0;
+	struct print_frame *stack = malloc(sizeof(*stack) * capacity);
+	assert(stack != NULL);
+	stack[length++] = (struct print_frame){ root, 0, true };
+
+	while (length > 0) {
+		struct print_frame frame = stack[--length];
+		const struct ast_node *node = frame.node;
+
+		// Print the tree structure
+		for (int i = 0; i < frame.level - 1; ++i) {
+			printf("│   ");
+		}
+
+		if (frame.level > 0) {
+			if (frame.last) {
+				printf("└── ");
+			} else {
+				printf("├── ");
+			}
+		}
+
+		// Print the node value
+		if (node->text)
+			printf("%.*s\n", (int)node->tok.length, node->text);
+		else
+			printf("NULL\n");
+
+		// Children are pushed last first so the first one is printed next
+		if (length + node->argc > capacity) {
+			capacity = (length + node->argc) * 2;
+			stack = realloc(stack, sizeof(*stack) * capacity);
+			assert(stack != NULL);
+		}
+		for (size_t i = node->argc; i > 0; --i) {
+			stack[length++] = (struct print_frame){
+				node->args[i - 1], frame.level + 1,
+				i == node->argc
+			};
+		}
 	}
-	free(node->args);
-	free(node);
+
+	free(stack);
 }
@@ -2,18 +2,49 @@
 #define AST_H
 
 #include "lexer.h"
+#include "scope_table.h"
+#include "command.h"
+
+struct arena;
 
 struct ast_node {
 	struct token tok;
+	struct source_pos pos; // Start of the token, 0 for PROG and EOF
+	const char *text; // Token text in the source, tok.length bytes long
+	struct string *string; // Interned text of identifiers and strings
+	const char *str; // Built once by ast_node_str
+	struct value result; // Value of an evaluated or folded subcommand
+	enum VALUE_TYPE type; // Of values, set by infer_types
+	command_func func; // Resolved by the parser, NULL for non-commands
+	uint32_t slot; // Variable of an identifier, set by the resolver
 	struct ast_node *parent;
+	struct arena *arena; // Owns the node and its args
 	struct ast_node **args;
 	size_t argc;
+	size_t capacity;
+};
+
+/*
+ * Post-order walk of a node and everything below it, children before their
+ * parent and left before right. The state lives on the heap, so the depth
+ * of the tree does not matter.
+ */
+struct ast_walk {
+	struct ast_walk_frame *frames;
+	size_t length;
+	size_t capacity;
 };
 
-struct ast_node *ast_node_create(struct token tok);
+struct ast_node *ast_node_create(struct arena *arena, struct token tok,
+				 struct source_pos pos, const char *text);
 void ast_delete_node(struct ast_node *node);
 void ast_add_arg(struct ast_node *node, struct ast_node *arg);
+const char *ast_node_str(struct ast_node *node);
 void ast_print(const struct ast_node *const node);
-void ast_free(struct ast_node *node);
+
+void ast_walk_init(struct ast_walk *walk, struct ast_node *root);
+// NULL once every node was returned
+struct ast_node *ast_walk_next(struct ast_walk *walk);
+void ast_walk_free(struct ast_walk *walk);
 
 #endif
@@ -0,0 +1,115 @@
+#include "error.h"
+#include "bytecode.h"
+#include "string_heap.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#define INITIAL_CODE_SIZE 64
+#define INITIAL_CONSTANTS_SIZE 16
+#define INITIAL_NODES_SIZE 4
+
+struct chunk *chunk_create()
+{
+	struct chunk *chunk = malloc(sizeof(*chunk));
+	assert(chunk != NULL);
+
+	chunk->code = malloc(INITIAL_CODE_SIZE * sizeof(struct instruction));
+	assert(chunk->code != NULL);
+
+	chunk->positions =
+		malloc(INITIAL_CODE_SIZE * sizeof(struct source_pos));
+	assert(chunk->positions != NULL);
+
+	chunk->constants =
+		malloc(INITIAL_CONSTANTS_SIZE * sizeof(struct value));
+	assert(chunk->constants != NULL);
+
+	chunk->nodes = malloc(INITIAL_NODES_SIZE * sizeof(struct ast_node *));
+	assert(chunk->nodes != NULL);
+
+	chunk->code_allocated = INITIAL_CODE_SIZE;
+	chunk->code_length = 0;
+	chunk->constants_allocated = INITIAL_CONSTANTS_SIZE;
+	chunk->constants_length = 0;
+	chunk->nodes_allocated = INITIAL_NODES_SIZE;
+	chunk->nodes_length = 0;
+	chunk->slot_count = 0;
+	chunk->max_stack = 0;
+	chunk->err = NULL;
+	chunk->mapping = NULL;
+	chunk->mapping_length = 0;
+
+	return chunk;
+}
+
+size_t chunk_emit(struct chunk *chunk, enum OPCODE op, uint32_t arg,
+		  struct source_pos pos)
+{
+	if (chunk->code_length >= chunk->code_allocated) {
+		chunk->code_allocated *= 2;
+		chunk->code = realloc(chunk->code, chunk->code_allocated *
+							   sizeof(struct instruction));
+		assert(chunk->code != NULL);
+
+		chunk->positions =
+			realloc(chunk->positions,
+				chunk->code_allocated *
+					sizeof(struct source_pos));
+		assert(chunk->positions != NULL);
+	}
+
+	chunk->code[chunk->code_length] = (struct instruction){ op, arg };
+	chunk->positions[chunk->code_length] = pos;
+	return chunk->code_length++;
+}
+
+// The chunk takes its own reference to string constants
+uint32_t chunk_add_constant(struct chunk *chunk, struct value val)
+{
+	if (chunk->constants_length >= chunk->constants_allocated) {
+		chunk->constants_allocated *= 2;
+		chunk->constants =
+			realloc(chunk->constants,
+				chunk->constants_allocated *
+					sizeof(struct value));
+		assert(chunk->constants != NULL);
+	}
+
+	value_retain(val);
+	chunk->constants[chunk->constants_length] = val;
+	return chunk->constants_length++;
+}
+
+uint32_t chunk_add_node(struct chunk *chunk, struct ast_node *node)
+{
+	if (chunk->nodes_length >= chunk->nodes_allocated) {
+		chunk->nodes_allocated *= 2;
+		chunk->nodes = realloc(chunk->nodes, chunk->nodes_allocated *
+							     sizeof(struct ast_node *));
+		assert(chunk->nodes != NULL);
+	}
+
+	chunk->nodes[chunk->nodes_length] = node;
+	return chunk->nodes_length++;
+}
+
+void chunk_free(struct chunk *chunk)
+{
+	if (!chunk)
+		return;
+
+	error_free(chunk->err);
+	for (size_t i = 0; i < chunk->constants_length; ++i) {
+		value_release(chunk->constants[i]);
+	}
+	if (chunk->mapping != NULL) {
+		munmap(chunk->mapping, chunk->mapping_length);
+	} else {
+		free(chunk->code);
+		free(chunk->positions);
+	}
+	free(chunk->constants);
+	free(chunk->nodes);
+	free(chunk);
+}
@@ -0,0 +1,75 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "scope_table.h"
+#include "source.h"
+
+struct error;
+struct ast_node;
+
+enum OPCODE {
+	OP_CONST, // Push constants[arg]
+	OP_LOAD, // Push the value of slot arg
+	OP_CREATE, // Pop into slot arg
+	OP_SET, // Pop into slot arg, keeping the type of the slot
+	OP_PRINT, // Pop and print
+	OP_ADD, // Operands of types only known while running
+	OP_SUB,
+	OP_MUL,
+	OP_DIV,
+	OP_ADD_INT, // Both operands are ints
+	OP_SUB_INT,
+	OP_MUL_INT,
+	OP_DIV_INT,
+	OP_ADD_DOUBLE, // Both operands are doubles
+	OP_SUB_DOUBLE,
+	OP_MUL_DOUBLE,
+	OP_DIV_DOUBLE,
+	OP_TO_DOUBLE, // Convert the int on top to a double
+	OP_TO_INT, // Convert the double on top to an int
+	OP_STORE, // Pop a number of the type of slot arg into it
+	OP_CALL, // Run nodes[arg] with the AST walker, for what has no opcode
+	OP_FAIL, // Raise chunk->err
+	OP_HALT,
+};
+
+struct instruction {
+	uint32_t op;
+	uint32_t arg;
+};
+
+struct chunk {
+	struct instruction *code;
+	struct source_pos *positions; // Only read when an instruction fails
+	size_t code_allocated;
+	size_t code_length;
+
+	struct value *constants;
+	size_t constants_allocated;
+	size_t constants_length;
+
+	struct ast_node **nodes; // Statements run by OP_CALL, owned by the AST
+	size_t nodes_allocated;
+	size_t nodes_length;
+
+	size_t slot_count; // Count of variables
+	size_t max_stack; // Deepest value stack the code can reach
+
+	struct error *err; // Error raised by OP_FAIL
+
+	// Read from a cache file, code and positions point into the mapping
+	void *mapping;
+	size_t mapping_length;
+};
+
+struct chunk *chunk_create();
+void chunk_free(struct chunk *chunk);
+
+size_t chunk_emit(struct chunk *chunk, enum OPCODE op, uint32_t arg,
+		  struct source_pos pos);
+uint32_t chunk_add_constant(struct chunk *chunk, struct value val);
+uint32_t chunk_add_node(struct chunk *chunk, struct ast_node *node);
+
+#endif
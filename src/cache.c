@@ -0,0 +1,499 @@
+#include "error.h"
+#include "bytecode.h"
+#include "string_heap.h"
+#include "source.h"
+#include "cache.h"
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define CACHE_MAGIC "DUCCACHE"
+#define CACHE_VERSION 3
+// Code and positions are mapped as they are, so their layout has to match
+#define CACHE_LAYOUT                                    \
+	((uint32_t)sizeof(struct instruction) << 16 | \
+	 (uint32_t)sizeof(struct source_pos))
+
+/*
+ * A header, then code, positions and constants, then the string pool and
+ * the message of the error. Sections start 8 byte aligned and are found
+ * from the lengths in the header, nothing in the file is a pointer. String
+ * constants hold the offset of a 4 byte length and the text in the pool.
+ * The checksum covers the whole file with the checksum itself set to 0.
+ */
+struct cache_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t layout;
+	uint64_t build; // Of the interpreter that wrote the file
+	int64_t mtime_sec;
+	int64_t mtime_nsec;
+	uint64_t size; // Of the program
+	uint64_t hash; // Of the program
+	uint64_t code_length;
+	uint64_t constants_length;
+	uint64_t strings_length;
+	uint64_t slot_count;
+	uint64_t max_stack;
+	uint64_t err_length; // With the NUL, 0 if the chunk has no error
+	uint64_t err_line;
+	uint64_t err_column;
+	uint32_t err_type;
+	uint32_t err_code;
+	uint64_t checksum;
+};
+
+static size_t align8(size_t n)
+{
+	return (n + 7) & ~(size_t)7;
+}
+
+// Hashes data after what hash was computed from
+static uint64_t hash_more(uint64_t hash, const char *data, size_t len)
+{
+	size_t i = 0;
+	for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+		uint64_t word;
+		memcpy(&word, data + i, sizeof(word));
+		hash = (hash ^ word) * 0x9E3779B97F4A7C15ull;
+		hash ^= hash >> 32;
+	}
+	for (; i < len; ++i) {
+		hash = (hash ^ (unsigned char)data[i]) * 0x100000001B3ull;
+	}
+	return hash ^ len;
+}
+
+static uint64_t hash_bytes(const char *data, size_t len)
+{
+	return hash_more(0xCBF29CE484222325ull, data, len);
+}
+
+static uint64_t checksum(const struct cache_header *header, const char *body,
+			 size_t len)
+{
+	struct cache_header copy = *header;
+	copy.checksum = 0;
+	return hash_more(hash_bytes((const char *)&copy, sizeof(copy)), body,
+			 len);
+}
+
+/*
+ * Identifies the interpreter binary, so a rebuild never runs bytecode of
+ * the previous build: relinking changes the size, time or inode of the
+ * executable. 0 if it can not be found, nothing is cached then.
+ */
+static uint64_t build_id(void)
+{
+	struct stat st;
+	if (stat("/proc/self/exe", &st) != 0) {
+		return 0;
+	}
+
+	uint64_t id[] = { CACHE_VERSION, OP_HALT, st.st_size, st.st_ino,
+			  st.st_mtim.tv_sec, st.st_mtim.tv_nsec };
+	return hash_bytes((const char *)id, sizeof(id)) | 1;
+}
+
+// Caller frees, NULL if the cache is turned off
+static char *cache_dir(void)
+{
+	const char *dir = getenv("DUC_CACHE_DIR");
+	const char *suffix = "";
+	if (dir != NULL) {
+		if (dir[0] == '\0') {
+			return NULL;
+		}
+	} else if ((dir = getenv("XDG_CACHE_HOME")) != NULL &&
+		   dir[0] != '\0') {
+		suffix = "/duc";
+	} else if ((dir = getenv("HOME")) != NULL && dir[0] != '\0') {
+		suffix = "/.cache/duc";
+	} else {
+		return NULL;
+	}
+
+	size_t len = strlen(dir) + strlen(suffix) + 1;
+	char *path = malloc(len);
+	assert(path != NULL);
+	snprintf(path, len, "%s%s", dir, suffix);
+	return path;
+}
+
+// Named by the hash of the absolute path of the program
+static char *cache_path(const char *filename, char **dir)
+{
+	if (strcmp(filename, "-") == 0) {
+		return NULL;
+	}
+	*dir = cache_dir();
+	if (*dir == NULL) {
+		return NULL;
+	}
+	char *absolute = realpath(filename, NULL);
+	if (absolute == NULL) {
+		free(*dir);
+		return NULL;
+	}
+
+	size_t len = strlen(*dir) + sizeof("/0123456789abcdef.ducc");
+	char *path = malloc(len);
+	assert(path != NULL);
+	snprintf(path, len, "%s/%016llx.ducc", *dir,
+		 (unsigned long long)hash_bytes(absolute, strlen(absolute)));
+	free(absolute);
+	return path;
+}
+
+static bool stat_program(const char *filename, const struct source *source,
+			 struct cache_header *header)
+{
+	struct stat st;
+	if (stat(filename, &st) != 0 || !S_ISREG(st.st_mode) ||
+	    (size_t)st.st_size != source->length) {
+		return false;
+	}
+
+	header->build = build_id();
+	if (header->build == 0) {
+		return false;
+	}
+	header->mtime_sec = st.st_mtim.tv_sec;
+	header->mtime_nsec = st.st_mtim.tv_nsec;
+	header->size = source->length;
+	header->hash = hash_bytes(source->data, source->length);
+	return true;
+}
+
+// The VM trusts its code, so a damaged file must not get that far
+static bool check_code(const struct chunk *chunk, size_t constants_length)
+{
+	size_t depth = 0;
+	for (size_t i = 0; i < chunk->code_length; ++i) {
+		struct instruction ins = chunk->code[i];
+		switch (ins.op) {
+		case OP_CONST:
+		case OP_LOAD:
+			if (ins.arg >= (ins.op == OP_CONST ? constants_length :
+							     chunk->slot_count) ||
+			    ++depth > chunk->max_stack) {
+				return false;
+			}
+			break;
+		case OP_TO_DOUBLE:
+		case OP_TO_INT:
+			if (depth == 0) {
+				return false;
+			}
+			break;
+		case OP_CREATE:
+		case OP_SET:
+		case OP_STORE:
+			if (ins.arg >= chunk->slot_count) {
+				return false;
+			}
+			// fallthrough
+		case OP_PRINT:
+			if (depth == 0) {
+				return false;
+			}
+			--depth;
+			break;
+		case OP_ADD:
+		case OP_SUB:
+		case OP_MUL:
+		case OP_DIV:
+		case OP_ADD_INT:
+		case OP_SUB_INT:
+		case OP_MUL_INT:
+		case OP_DIV_INT:
+		case OP_ADD_DOUBLE:
+		case OP_SUB_DOUBLE:
+		case OP_MUL_DOUBLE:
+		case OP_DIV_DOUBLE:
+			if (depth < 2) {
+				return false;
+			}
+			--depth;
+			break;
+		case OP_FAIL:
+			if (chunk->err == NULL) {
+				return false;
+			}
+			break;
+		case OP_HALT:
+			break;
+		default:
+			return false;
+		}
+	}
+	return chunk->code[chunk->code_length - 1].op == OP_HALT;
+}
+
+// Checks every length against the size of the file before using it
+static bool read_sections(struct chunk *chunk, const char *data, size_t size,
+			  const struct cache_header *header)
+{
+	size_t offset = align8(sizeof(*header));
+	if (header->code_length > size / sizeof(struct instruction) ||
+	    header->constants_length > size / sizeof(uint64_t) ||
+	    header->strings_length > size || header->err_length > size) {
+		return false;
+	}
+
+	size_t code = offset;
+	offset = align8(offset + header->code_length *
+					 sizeof(struct instruction));
+	size_t positions = offset;
+	offset = align8(offset + header->code_length *
+					 sizeof(struct source_pos));
+	size_t constants = offset;
+	offset += header->constants_length * sizeof(uint64_t);
+	size_t strings = offset;
+	offset = align8(offset + header->strings_length);
+	size_t message = offset;
+	offset += header->err_length;
+	if (offset != size || header->code_length == 0 ||
+	    checksum(header, data + code, size - code) != header->checksum) {
+		return false;
+	}
+
+	chunk->code = (struct instruction *)(data + code);
+	chunk->positions = (struct source_pos *)(data + positions);
+	chunk->code_length = header->code_length;
+	chunk->code_allocated = header->code_length;
+
+	for (size_t i = 0; i < header->constants_length; ++i) {
+		struct value val;
+		memcpy(&val.bits, data + constants + i * sizeof(uint64_t),
+		       sizeof(val.bits));
+		if (!value_is_str(val)) {
+			chunk_add_constant(chunk, val);
+			continue;
+		}
+
+		uint64_t at = val.bits & VALUE_PAYLOAD_MASK;
+		uint32_t len;
+		if (at + sizeof(len) > header->strings_length) {
+			return false;
+		}
+		memcpy(&len, data + strings + at, sizeof(len));
+		if (len > header->strings_length - at - sizeof(len)) {
+			return false;
+		}
+		val = value_str(
+			string_intern(data + strings + at + sizeof(len), len));
+		chunk_add_constant(chunk, val);
+		value_release(val);
+	}
+
+	if (header->err_length > 0) {
+		if (data[message + header->err_length - 1] != '\0') {
+			return false;
+		}
+		chunk->err = error_create(header->err_type, header->err_code,
+					  header->err_line, header->err_column,
+					  "%s", data + message);
+	}
+	return check_code(chunk, header->constants_length);
+}
+
+struct chunk *cache_load(const char *filename, const struct source *source)
+{
+	char *dir;
+	char *path = cache_path(filename, &dir);
+	if (path == NULL) {
+		return NULL;
+	}
+	free(dir);
+
+	int fd = open(path, O_RDONLY);
+	free(path);
+	if (fd < 0) {
+		return NULL;
+	}
+
+	struct stat st;
+	void *data = MAP_FAILED;
+	if (fstat(fd, &st) == 0 &&
+	    (size_t)st.st_size >= sizeof(struct cache_header)) {
+		data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+	close(fd);
+	if (data == MAP_FAILED) {
+		return NULL;
+	}
+
+	const struct cache_header *header = data;
+	struct cache_header program;
+	if (memcmp(header->magic, CACHE_MAGIC, sizeof(header->magic)) != 0 ||
+	    header->version != CACHE_VERSION ||
+	    header->layout != CACHE_LAYOUT ||
+	    !stat_program(filename, source, &program) ||
+	    header->build != program.build ||
+	    header->mtime_sec != program.mtime_sec ||
+	    header->mtime_nsec != program.mtime_nsec ||
+	    header->size != program.size || header->hash != program.hash ||
+	    // Sizes of the VM allocations, each push is an instruction and
+	    // each variable has its own CREATE in the program text
+	    header->max_stack > header->code_length ||
+	    header->slot_count > header->size) {
+		munmap(data, st.st_size);
+		return NULL;
+	}
+
+	struct chunk *chunk = chunk_create();
+	free(chunk->code);
+	free(chunk->positions);
+	chunk->mapping = data;
+	chunk->mapping_length = st.st_size;
+	chunk->slot_count = header->slot_count;
+	chunk->max_stack = header->max_stack;
+	if (!read_sections(chunk, data, st.st_size, header)) {
+		chunk_free(chunk);
+		return NULL;
+	}
+	return chunk;
+}
+
+static void make_dirs(char *path)
+{
+	for (char *p = path + 1; *p != '\0'; ++p) {
+		if (*p == '/') {
+			*p = '\0';
+			mkdir(path, 0755);
+			*p = '/';
+		}
+	}
+	mkdir(path, 0755);
+}
+
+static bool write_padded(FILE *file, const void *data, size_t len)
+{
+	static const char zeros[8] = { 0 };
+	return fwrite(data, 1, len, file) == len &&
+	       fwrite(zeros, 1, align8(len) - len, file) == align8(len) - len;
+}
+
+static bool write_chunk(FILE *file, const struct chunk *chunk,
+			struct cache_header *header)
+{
+	uint64_t *constants =
+		malloc((chunk->constants_length + 1) * sizeof(uint64_t));
+	assert(constants != NULL);
+	size_t strings_allocated = 64;
+	char *strings = malloc(strings_allocated);
+	assert(strings != NULL);
+	size_t strings_length = 0;
+
+	for (size_t i = 0; i < chunk->constants_length; ++i) {
+		struct value val = chunk->constants[i];
+		if (!value_is_str(val)) {
+			constants[i] = val.bits;
+			continue;
+		}
+
+		const struct string *str = value_as_str(val);
+		uint32_t len = str->length;
+		while (strings_length + sizeof(len) + len > strings_allocated) {
+			strings_allocated *= 2;
+			strings = realloc(strings, strings_allocated);
+			assert(strings != NULL);
+		}
+		constants[i] = VALUE_TAG_STR << VALUE_TAG_SHIFT |
+			       strings_length;
+		memcpy(strings + strings_length, &len, sizeof(len));
+		memcpy(strings + strings_length + sizeof(len), str->data, len);
+		strings_length += sizeof(len) + len;
+	}
+
+	header->code_length = chunk->code_length;
+	header->constants_length = chunk->constants_length;
+	header->strings_length = strings_length;
+	header->slot_count = chunk->slot_count;
+	header->max_stack = chunk->max_stack;
+	if (chunk->err != NULL) {
+		header->err_length = strlen(chunk->err->message) + 1;
+		header->err_line = chunk->err->line;
+		header->err_column = chunk->err->column;
+		header->err_type = chunk->err->type;
+		header->err_code = chunk->err->code;
+	}
+
+	// Written to memory first, the checksum goes in front of it
+	char *body;
+	size_t body_length;
+	FILE *out = open_memstream(&body, &body_length);
+	assert(out != NULL);
+	bool ok = write_padded(out, chunk->code,
+			       chunk->code_length *
+				       sizeof(struct instruction)) &&
+		  write_padded(out, chunk->positions,
+			       chunk->code_length *
+				       sizeof(struct source_pos)) &&
+		  write_padded(out, constants,
+			       chunk->constants_length * sizeof(uint64_t)) &&
+		  write_padded(out, strings, strings_length) &&
+		  (chunk->err == NULL ||
+		   fwrite(chunk->err->message, 1, header->err_length, out) ==
+			   header->err_length);
+	ok = fclose(out) == 0 && ok;
+
+	header->checksum = checksum(header, body, body_length);
+	ok = ok && write_padded(file, header, sizeof(*header)) &&
+	     fwrite(body, 1, body_length, file) == body_length;
+
+	free(body);
+	free(constants);
+	free(strings);
+	return ok;
+}
+
+void cache_store(const char *filename, const struct source *source,
+		 const struct chunk *chunk)
+{
+	// OP_CALL runs AST nodes, which are not kept
+	if (chunk->nodes_length > 0) {
+		return;
+	}
+
+	struct cache_header header = { .version = CACHE_VERSION,
+				       .layout = CACHE_LAYOUT };
+	memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+	char *dir;
+	char *path = cache_path(filename, &dir);
+	if (path == NULL) {
+		return;
+	}
+	if (!stat_program(filename, source, &header)) {
+		free(dir);
+		free(path);
+		return;
+	}
+	make_dirs(dir);
+	free(dir);
+
+	// Written aside and renamed, readers never see half a file
+	size_t len = strlen(path) + 32;
+	char *temp = malloc(len);
+	assert(temp != NULL);
+	snprintf(temp, len, "%s.%ld", path, (long)getpid());
+
+	FILE *file = fopen(temp, "wb");
+	if (file != NULL) {
+		bool ok = write_chunk(file, chunk, &header);
+		if (fclose(file) == 0 && ok) {
+			ok = rename(temp, path) == 0;
+		}
+		if (!ok) {
+			unlink(temp);
+		}
+	}
+
+	free(temp);
+	free(path);
+}
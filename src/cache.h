@@ -0,0 +1,27 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+struct chunk;
+struct source;
+
+/*
+ * Compiled programs are kept on disk so running an unchanged program again
+ * skips the lexer, parser, resolver and compiler. A cache file belongs to
+ * the absolute path of a program and is only used while the modification
+ * time, size and content hash of the program, and the interpreter binary
+ * that wrote it, still match. Files live in $DUC_CACHE_DIR,
+ * $XDG_CACHE_HOME/duc or $HOME/.cache/duc, setting DUC_CACHE_DIR to an
+ * empty string turns the cache off.
+ */
+
+/*
+ * Maps the cache file of filename and returns its chunk, the code is run
+ * straight from the mapping. Returns NULL on a miss.
+ */
+struct chunk *cache_load(const char *filename, const struct source *source);
+
+// Writes chunk as the cache file of filename, failures are ignored
+void cache_store(const char *filename, const struct source *source,
+		 const struct chunk *chunk);
+
+#endif
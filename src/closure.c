@@ -0,0 +1,449 @@
+#include "error.h"
+#include "ast.h"
+#include "arena.h"
+#include "command.h"
+#include "command_funcs.h"
+#include "resolver.h"
+#include "arithmetic.h"
+#include "output.h"
+#include "string_heap.h"
+#include "vm.h"
+#include "closure.h"
+#include <assert.h>
+
+// Deeper statements are walked, calling closures recurses on the C stack
+#define CLOSURE_MAX_DEPTH 256
+#define INITIAL_OPERANDS_SIZE 16
+
+struct closure_frame {
+	struct value *slots;
+	size_t slot_count;
+	bool failed;
+	struct error *err; // NULL if the failure was printed already
+};
+
+struct closure;
+
+typedef struct value (*closure_func)(const struct closure *c,
+				     struct closure_frame *frame);
+
+// Where a value comes from, which one is fixed by the closure function
+struct closure_operand {
+	const struct closure *tree;
+	struct value constant;
+	uint32_t slot;
+};
+
+struct closure {
+	closure_func func;
+	struct closure_operand x;
+	struct closure_operand y;
+	uint32_t slot; // Variable a statement writes
+	struct source_pos pos; // Reported when it fails
+	const char *text; // Printed by PRINT of a literal
+	struct ast_node *node; // Statement run by the walker
+	const struct closure *next; // Statement after this one
+};
+
+enum OPERAND_KIND { OPERAND_SLOT, OPERAND_CONST, OPERAND_TREE };
+
+static struct value fail(const struct closure *c, struct closure_frame *frame,
+			 const char *message)
+{
+	frame->failed = true;
+	frame->err = error_create(ERROR_INTERPRETER, ERROR_RUNTIME_ERROR,
+				  c->pos.line, c->pos.column, "%s", message);
+	return value_int(0);
+}
+
+#define GET_SLOT(o) frame->slots[(o).slot]
+#define GET_CONST(o) (o).constant
+#define GET_TREE(o) (o).tree->func((o).tree, frame)
+
+// Untyped operands are checked while running
+#define ANY_RESULT(int_expr, double_op, div)                              \
+	if (arith_is_int(x, y)) {                                         \
+		int a = value_as_int(x);                                  \
+		int b = value_as_int(y);                                  \
+		if (div && b == 0) {                                      \
+			return fail(c, frame, "Division by zero");        \
+		}                                                         \
+		return value_int(int_expr);                               \
+	}                                                                 \
+	if (arith_is_num(x) && arith_is_num(y)) {                         \
+		return value_double(arith_to_double(x) double_op          \
+					    arith_to_double(y));          \
+	}                                                                 \
+	return fail(c, frame, "Can not do arithmetic on a string");
+
+// Both operands are known to be ints
+#define INT_RESULT(int_expr, double_op, div)                   \
+	int a = value_as_int(x);                               \
+	int b = value_as_int(y);                               \
+	if (div && b == 0) {                                   \
+		return fail(c, frame, "Division by zero");     \
+	}                                                      \
+	return value_int(int_expr);
+
+// Both operands are known to be numbers and the result a double
+#define DOUBLE_RESULT(int_expr, double_op, div) \
+	return value_double(arith_to_double(x) double_op arith_to_double(y));
+
+/*
+ * One function per operation, static type of the result and kind of each
+ * operand. A failed operand returns a placeholder right away, y is not
+ * evaluated once x failed.
+ */
+#define ARITHMETIC_CLOSURE(name, get_x, get_y, result, int_expr, double_op, \
+			   div)                                             \
+	static struct value name(const struct closure *c,                   \
+				 struct closure_frame *frame)               \
+	{                                                                   \
+		struct value x = get_x(c->x);                               \
+		if (frame->failed) {                                        \
+			return x;                                           \
+		}                                                           \
+		struct value y = get_y(c->y);                               \
+		if (frame->failed) {                                        \
+			return y;                                           \
+		}                                                           \
+		result(int_expr, double_op, div)                            \
+	}
+
+#define ARITHMETIC_CLOSURES(op, ...)                                        \
+	ARITHMETIC_CLOSURE(op##_slot_slot, GET_SLOT, GET_SLOT, __VA_ARGS__)   \
+	ARITHMETIC_CLOSURE(op##_slot_const, GET_SLOT, GET_CONST, __VA_ARGS__) \
+	ARITHMETIC_CLOSURE(op##_slot_tree, GET_SLOT, GET_TREE, __VA_ARGS__)   \
+	ARITHMETIC_CLOSURE(op##_const_slot, GET_CONST, GET_SLOT, __VA_ARGS__) \
+	ARITHMETIC_CLOSURE(op##_const_const, GET_CONST, GET_CONST,            \
+			   __VA_ARGS__)                                       \
+	ARITHMETIC_CLOSURE(op##_const_tree, GET_CONST, GET_TREE, __VA_ARGS__) \
+	ARITHMETIC_CLOSURE(op##_tree_slot, GET_TREE, GET_SLOT, __VA_ARGS__)   \
+	ARITHMETIC_CLOSURE(op##_tree_const, GET_TREE, GET_CONST, __VA_ARGS__) \
+	ARITHMETIC_CLOSURE(op##_tree_tree, GET_TREE, GET_TREE, __VA_ARGS__)
+
+#define TYPED_CLOSURES(op, int_expr, double_op, div)                          \
+	ARITHMETIC_CLOSURES(op, ANY_RESULT, int_expr, double_op, div)         \
+	ARITHMETIC_CLOSURES(op##_int, INT_RESULT, int_expr, double_op, div)   \
+	ARITHMETIC_CLOSURES(op##_double, DOUBLE_RESULT, int_expr, double_op,  \
+			    div)
+
+TYPED_CLOSURES(add, arith_int_add(a, b), +, false)
+TYPED_CLOSURES(sub, arith_int_sub(a, b), -, false)
+TYPED_CLOSURES(mul, arith_int_mul(a, b), *, false)
+TYPED_CLOSURES(div, arith_int_div(a, b), /, true)
+
+#define OPERAND_FUNCS(op)                                             \
+	{                                                             \
+		{ op##_slot_slot, op##_slot_const, op##_slot_tree },    \
+		{ op##_const_slot, op##_const_const, op##_const_tree }, \
+		{ op##_tree_slot, op##_tree_const, op##_tree_tree },    \
+	}
+
+// Indexed by the kinds of the operands
+static const struct {
+	command_func func;
+	closure_func funcs[3][3];
+	closure_func int_funcs[3][3];
+	closure_func double_funcs[3][3];
+} arithmetic_closures[] = {
+	{ subcommand_func_add, OPERAND_FUNCS(add), OPERAND_FUNCS(add_int),
+	  OPERAND_FUNCS(add_double) },
+	{ subcommand_func_sub, OPERAND_FUNCS(sub), OPERAND_FUNCS(sub_int),
+	  OPERAND_FUNCS(sub_double) },
+	{ subcommand_func_mul, OPERAND_FUNCS(mul), OPERAND_FUNCS(mul_int),
+	  OPERAND_FUNCS(mul_double) },
+	{ subcommand_func_div, OPERAND_FUNCS(div), OPERAND_FUNCS(div_int),
+	  OPERAND_FUNCS(div_double) },
+};
+
+#define STATEMENT_CLOSURES(name, body)                                    \
+	static struct value name##_slot(const struct closure *c,          \
+					struct closure_frame *frame)      \
+	{                                                                 \
+		struct value val = GET_SLOT(c->x);                        \
+		body                                                      \
+	}                                                                 \
+	static struct value name##_const(const struct closure *c,         \
+					 struct closure_frame *frame)     \
+	{                                                                 \
+		(void)frame;                                              \
+		struct value val = GET_CONST(c->x);                       \
+		body                                                      \
+	}                                                                 \
+	static struct value name##_tree(const struct closure *c,          \
+					struct closure_frame *frame)      \
+	{                                                                 \
+		struct value val = GET_TREE(c->x);                        \
+		if (frame->failed) {                                      \
+			return val;                                       \
+		}                                                         \
+		body                                                      \
+	}
+
+STATEMENT_CLOSURES(create, {
+	value_retain(val);
+	frame->slots[c->slot] = val;
+	return val;
+})
+
+STATEMENT_CLOSURES(set, {
+	if (!vm_assign(&frame->slots[c->slot], val)) {
+		return fail(
+			c, frame,
+			"Can not assign a value of a different type to a variable");
+	}
+	return val;
+})
+
+STATEMENT_CLOSURES(print, {
+	output_value(val);
+	output_char('\n');
+	return val;
+})
+
+#undef STATEMENT_CLOSURES
+#undef OPERAND_FUNCS
+#undef TYPED_CLOSURES
+#undef ARITHMETIC_CLOSURES
+#undef ARITHMETIC_CLOSURE
+#undef DOUBLE_RESULT
+#undef INT_RESULT
+#undef ANY_RESULT
+#undef GET_TREE
+#undef GET_CONST
+#undef GET_SLOT
+
+static const closure_func create_funcs[] = { create_slot, create_const,
+					     create_tree };
+static const closure_func set_funcs[] = { set_slot, set_const, set_tree };
+static const closure_func print_funcs[] = { print_slot, print_const,
+					    print_tree };
+
+// Literals are printed exactly as they were written
+static struct value print_text(const struct closure *c,
+			       struct closure_frame *frame)
+{
+	(void)frame;
+	output_str(c->text);
+	output_char('\n');
+	return value_int(0);
+}
+
+// Errors of the walker are printed by it
+static struct value call(const struct closure *c, struct closure_frame *frame)
+{
+	struct frame walker_frame = { .slots = frame->slots,
+				      .slot_count = frame->slot_count };
+	if (interpret_statement(c->node, &walker_frame) != EXT_SUCCESS) {
+		frame->failed = true;
+	}
+	return value_int(0);
+}
+
+static struct value run_program(const struct closure *c,
+				struct closure_frame *frame)
+{
+	for (const struct closure *s = c->next; s != NULL; s = s->next) {
+		s->func(s, frame);
+		if (frame->failed) {
+			break;
+		}
+	}
+	return value_int(0);
+}
+
+struct operand {
+	enum OPERAND_KIND kind;
+	struct closure_operand value;
+	size_t depth; // Of the closures below and including this one
+};
+
+struct builder {
+	struct arena *arena;
+	struct operand *operands; // Stack of built operands
+	size_t length;
+	size_t capacity;
+};
+
+static struct closure *closure_create(struct builder *b, closure_func func,
+				      const struct ast_node *node)
+{
+	struct closure *c = arena_alloc(b->arena, sizeof(*c));
+	*c = (struct closure){ .func = func, .pos = node->pos };
+	return c;
+}
+
+static void push_operand(struct builder *b, struct operand op)
+{
+	if (b->length == b->capacity) {
+		b->capacity *= 2;
+		b->operands = realloc(b->operands,
+				      sizeof(*b->operands) * b->capacity);
+		assert(b->operands != NULL);
+	}
+	b->operands[b->length++] = op;
+}
+
+static bool build_subcommand(struct builder *b, const struct ast_node *node)
+{
+	size_t i = 0;
+	while (i < sizeof(arithmetic_closures) /
+			   sizeof(arithmetic_closures[0]) &&
+	       arithmetic_closures[i].func != node->func) {
+		++i;
+	}
+	if (i == sizeof(arithmetic_closures) / sizeof(arithmetic_closures[0])) {
+		return false;
+	}
+
+	struct operand y = b->operands[--b->length];
+	struct operand x = b->operands[--b->length];
+	size_t depth = (x.depth > y.depth ? x.depth : y.depth) + 1;
+	if (depth > CLOSURE_MAX_DEPTH) {
+		return false;
+	}
+
+	// The static type of the result leaves out the checks of the operands
+	closure_func func = arithmetic_closures[i].funcs[x.kind][y.kind];
+	if (node->type == VALUE_INT) {
+		func = arithmetic_closures[i].int_funcs[x.kind][y.kind];
+	} else if (node->type == VALUE_DOUBLE) {
+		func = arithmetic_closures[i].double_funcs[x.kind][y.kind];
+	}
+	struct closure *c = closure_create(b, func, node);
+	c->x = x.value;
+	c->y = y.value;
+	push_operand(b, (struct operand){ .kind = OPERAND_TREE,
+					  .value = { .tree = c },
+					  .depth = depth });
+	return true;
+}
+
+// Operands are built in post-order, each subcommand after its operands
+static bool build_value(struct builder *b, struct ast_node *node,
+			struct operand *result)
+{
+	struct ast_walk walk;
+	ast_walk_init(&walk, node);
+
+	bool built = true;
+	const struct ast_node *curr;
+	while (built && (curr = ast_walk_next(&walk)) != NULL) {
+		struct operand op = { .kind = OPERAND_CONST, .depth = 0 };
+		switch (curr->tok.type) {
+		case TOKEN_INT:
+			op.value.constant = value_int(curr->tok.int_val);
+			break;
+		case TOKEN_DOUBLE:
+			op.value.constant = value_double(curr->tok.double_val);
+			break;
+		case TOKEN_STR:
+			// Borrowed, the AST outlives its closures
+			op.value.constant = value_str(curr->string);
+			break;
+		case TOKEN_CONSTANT:
+			op.value.constant = curr->result;
+			break;
+		case TOKEN_IDENTIFIER:
+			op.kind = OPERAND_SLOT;
+			op.value.slot = curr->slot;
+			break;
+		default:
+			built = build_subcommand(b, curr);
+			continue;
+		}
+		push_operand(b, op);
+	}
+
+	ast_walk_free(&walk);
+	if (!built) {
+		b->length = 0;
+		return false;
+	}
+	*result = b->operands[--b->length];
+	return true;
+}
+
+static struct closure *build_statement(struct builder *b,
+				       struct ast_node *node)
+{
+	const closure_func *funcs;
+	if (node->func == command_func_create) {
+		funcs = create_funcs;
+	} else if (node->func == command_func_set) {
+		funcs = set_funcs;
+	} else if (node->func == command_func_print) {
+		funcs = print_funcs;
+	} else {
+		funcs = NULL;
+	}
+
+	struct ast_node *arg = node->argc > 1 ? node->args[1] : node->args[0];
+	enum TOKEN_TYPE type = arg->tok.type;
+	struct closure *c;
+	struct operand value;
+	if (funcs == print_funcs &&
+	    (type == TOKEN_INT || type == TOKEN_DOUBLE || type == TOKEN_STR)) {
+		c = closure_create(b, print_text, node);
+		c->text = ast_node_str(arg);
+	} else if (funcs != NULL && build_value(b, arg, &value)) {
+		c = closure_create(b, funcs[value.kind], node);
+		c->x = value.value;
+		if (funcs != print_funcs) {
+			c->slot = node->args[0]->slot;
+		}
+	} else {
+		c = closure_create(b, call, node);
+		c->node = node;
+	}
+	return c;
+}
+
+enum EXT_CODE closure_run(const struct ast_node *const ast,
+			  const struct resolution *res)
+{
+	struct builder b = {
+		.arena = ast->arena,
+		.operands = malloc(sizeof(struct operand) *
+				   INITIAL_OPERANDS_SIZE),
+		.length = 0,
+		.capacity = INITIAL_OPERANDS_SIZE,
+	};
+	assert(b.operands != NULL);
+
+	struct closure *root = closure_create(&b, run_program, ast);
+	struct closure *last = root;
+	for (size_t i = 0; i < res->statement_count; ++i) {
+		struct closure *c = build_statement(&b, ast->args[i]);
+		last->next = c;
+		last = c;
+	}
+	free(b.operands);
+
+	struct closure_frame frame = {
+		.slots = calloc(res->slot_count + 1, sizeof(struct value)),
+		.slot_count = res->slot_count,
+		.failed = false,
+		.err = NULL,
+	};
+	assert(frame.slots != NULL);
+
+	root->func(root, &frame);
+
+	enum EXT_CODE result = EXT_SUCCESS;
+	if (frame.failed) {
+		error_print(frame.err);
+		error_free(frame.err);
+		result = EXT_FAIL;
+	} else if (res->err != NULL) {
+		error_print(res->err);
+		result = EXT_FAIL;
+	}
+
+	for (size_t i = 0; i < frame.slot_count; ++i) {
+		value_release(frame.slots[i]);
+	}
+	free(frame.slots);
+	return result;
+}
@@ -0,0 +1,20 @@
+#ifndef CLOSURE_H
+#define CLOSURE_H
+
+#include "interpreter.h"
+
+struct ast_node;
+struct resolution;
+
+/*
+ * Converts a resolved and folded program once into a tree of closures and
+ * runs it by calling the root. Each closure is a function specialized for
+ * where its operands come from, a slot, a constant or another closure, so
+ * running it looks at no token types and no command names. Statements the
+ * closures can not express, or nested too deep to call recursively, are run
+ * by the AST walker. Closures live in the arena of the AST.
+ */
+enum EXT_CODE closure_run(const struct ast_node *const ast,
+			  const struct resolution *res);
+
+#endif
@@ -1,4 +1,3 @@
-#include "symbol_table.h"
 #include "ast.h"
 #include "command.h"
 #include <assert.h>
@@ -10,6 +9,7 @@
 
 static void resize_commands(struct command_base *cb);
 static void resize_subcommands(struct command_base *cb);
+static void build_keywords(struct command_base *cb);
 
 struct command_base *command_base_create()
 {
@@ -29,6 +29,11 @@ struct command_base *command_base_create()
 	cb->subcommands_allocated = INITIAL_SUBCOMMANDS_SIZE;
 	cb->subcommands_length = 0;
 
+	cb->keywords = NULL;
+	cb->keywords_mask = 0;
+	cb->keywords_seed = 0;
+	cb->max_keyword_length = 0;
+
 	return cb;
 }
 
@@ -43,6 +48,8 @@ void command_register(struct command_base *cb, const char *name,
 	cb->commands[cb->commands_length].func = func;
 	cb->commands[cb->commands_length].max_argc = max_argc;
 	++cb->commands_length;
+
+	build_keywords(cb);
 }
 
 void subcommand_register(struct command_base *cb, const char *name,
@@ -56,6 +63,8 @@ void subcommand_register(struct command_base *cb, const char *name,
 	cb->subcommands[cb->subcommands_length].func = func;
 	cb->subcommands[cb->subcommands_length].max_argc = max_argc;
 	++cb->subcommands_length;
+
+	build_keywords(cb);
 }
 
 static void resize_commands(struct command_base *cb)
@@ -75,44 +84,145 @@ static void resize_subcommands(struct command_base *cb)
 	assert(cb->subcommands != NULL);
 }
 
-void command_exec(struct command_base *cb, struct ast_node *command_node,
-		  struct symbol_table *sym_table, struct error **err)
+void command_exec(struct ast_node *command_node, struct frame *frame,
+		  struct error **err)
+{
+	command_node->func(command_node, frame, err);
+}
+
+#define MIN_KEYWORDS_SIZE 8
+// Seeds tried before the table is made bigger
+#define MAX_KEYWORD_SEEDS 1024
+
+static uint64_t keyword_hash(const char *name, size_t len, uint64_t seed)
+{
+	uint64_t hash = seed ^ (len * 0x9E3779B97F4A7C15ull);
+	for (size_t i = 0; i < len; ++i) {
+		hash = (hash ^ (unsigned char)name[i]) * 0x100000001B3ull;
+	}
+	return hash ^ (hash >> 29);
+}
+
+static bool keyword_exists(const struct keyword *keywords, size_t length,
+			   const char *name)
+{
+	for (size_t i = 0; i < length; ++i) {
+		if (strcmp(keywords[i].name, name) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Every distinct name, commands first so they win over subcommands
+static size_t collect_keywords(const struct command_base *cb,
+			       struct keyword *keywords)
 {
-	struct command c;
-	if (command_node->tok.type == TOKEN_COMMAND) {
-		c = command_get(cb, command_node->tok.value);
-	} else if (command_node->tok.type == TOKEN_SUBCOMMAND) {
-		c = subcommand_get(cb, command_node->tok.value);
+	size_t length = 0;
+	for (size_t i = 0; i < cb->commands_length + cb->subcommands_length;
+	     ++i) {
+		bool subcommand = i >= cb->commands_length;
+		size_t index = subcommand ? i - cb->commands_length : i;
+		const char *name = subcommand ?
+					   cb->subcommands[index].command_name :
+					   cb->commands[index].command_name;
+		if (keyword_exists(keywords, length, name)) {
+			continue;
+		}
+
+		keywords[length++] = (struct keyword){ .name = name,
+						       .length = strlen(name),
+						       .index = index,
+						       .subcommand = subcommand };
 	}
-	c.func(command_node, sym_table, err);
+	return length;
 }
 
-struct command command_get(struct command_base *cb, const char *name)
+// Places every keyword with seed, false if two of them share a slot
+static bool place_keywords(struct keyword *table, size_t mask,
+			   const struct keyword *keywords, size_t length,
+			   uint64_t seed)
 {
-	for (size_t i = 0; i < cb->commands_length; ++i) {
-		if (strcmp(cb->commands[i].command_name, name) == 0) {
-			return cb->commands[i];
+	memset(table, 0, sizeof(*table) * (mask + 1));
+	for (size_t i = 0; i < length; ++i) {
+		size_t slot =
+			keyword_hash(keywords[i].name, keywords[i].length,
+				     seed) &
+			mask;
+		if (table[slot].name != NULL) {
+			return false;
 		}
+		table[slot] = keywords[i];
 	}
-	return (struct command){ .command_name = "" };
+	return true;
 }
 
-struct command subcommand_get(struct command_base *cb, const char *name)
+static bool find_seed(struct command_base *cb, const struct keyword *keywords,
+		      size_t length)
 {
-	for (size_t i = 0; i < cb->subcommands_length; ++i) {
-		if (strcmp(cb->subcommands[i].command_name, name) == 0) {
-			return cb->subcommands[i];
+	for (uint64_t seed = 1; seed <= MAX_KEYWORD_SEEDS; ++seed) {
+		if (place_keywords(cb->keywords, cb->keywords_mask, keywords,
+				   length, seed)) {
+			cb->keywords_seed = seed;
+			return true;
 		}
 	}
-	return (struct command){ .command_name = "" };
+	return false;
 }
 
-bool command_exists(struct command_base *cb, const char *name)
+static void build_keywords(struct command_base *cb)
 {
-	return strcmp(command_get(cb, name).command_name, "") != 0;
+	struct keyword *keywords =
+		malloc(sizeof(*keywords) *
+		       (cb->commands_length + cb->subcommands_length));
+	assert(keywords != NULL);
+	size_t length = collect_keywords(cb, keywords);
+
+	size_t size = MIN_KEYWORDS_SIZE;
+	while (size < length * 2) {
+		size *= 2;
+	}
+
+	free(cb->keywords);
+	for (;;) {
+		cb->keywords = malloc(sizeof(*cb->keywords) * size);
+		assert(cb->keywords != NULL);
+		cb->keywords_mask = size - 1;
+
+		if (find_seed(cb, keywords, length)) {
+			break;
+		}
+		free(cb->keywords);
+		size *= 2;
+	}
+
+	cb->max_keyword_length = 0;
+	for (size_t i = 0; i < length; ++i) {
+		if (keywords[i].length > cb->max_keyword_length) {
+			cb->max_keyword_length = keywords[i].length;
+		}
+	}
+	free(keywords);
 }
 
-bool subcommand_exists(struct command_base *cb, const char *name)
+const struct command *command_lookup(const struct command_base *cb,
+				     const char *name, size_t len,
+				     bool *subcommand)
 {
-	return strcmp(subcommand_get(cb, name).command_name, "") != 0;
+	// Most words are variables, long ones are ruled out without hashing
+	if (cb->keywords == NULL || len > cb->max_keyword_length) {
+		return NULL;
+	}
+
+	const struct keyword *keyword =
+		&cb->keywords[keyword_hash(name, len, cb->keywords_seed) &
+			      cb->keywords_mask];
+	if (keyword->name == NULL || keyword->length != len ||
+	    memcmp(keyword->name, name, len) != 0) {
+		return NULL;
+	}
+
+	*subcommand = keyword->subcommand;
+	return keyword->subcommand ? &cb->subcommands[keyword->index] :
+				     &cb->commands[keyword->index];
 }
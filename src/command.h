@@ -2,14 +2,21 @@
 #define COMMAND_H
 
 #include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
 
 struct ast_node;
 struct error;
-struct symbol_table;
+struct value;
+
+// Variables of a running program, indexed by the slots of the resolver
+struct frame {
+	struct value *slots;
+	size_t slot_count;
+};
 
 typedef void (*command_func)(struct ast_node *command_node,
-			     struct symbol_table *sym_table,
-			     struct error **err);
+			     struct frame *frame, struct error **err);
 
 struct command {
 	const char *command_name;
@@ -17,6 +24,14 @@ struct command {
 	command_func func;
 };
 
+// Slot of the keyword table, name is NULL for empty slots
+struct keyword {
+	const char *name;
+	size_t length;
+	size_t index; // In commands or subcommands
+	bool subcommand;
+};
+
 // List to store reserved commands
 struct command_base {
 	struct command *commands;
@@ -25,6 +40,16 @@ struct command_base {
 	size_t commands_length;
 	size_t subcommands_allocated;
 	size_t subcommands_length;
+
+	/*
+	 * Perfect hash of every registered name, rebuilt on each registration
+	 * with a seed that gives every name its own slot. A lookup hashes the
+	 * word once and compares it with a single candidate.
+	 */
+	struct keyword *keywords;
+	size_t keywords_mask;
+	uint64_t keywords_seed;
+	size_t max_keyword_length;
 };
 
 struct command_base *command_base_create();
@@ -34,13 +59,15 @@ void command_register(struct command_base *cb, const char *name,
 void subcommand_register(struct command_base *cb, const char *name,
 			 command_func func, size_t max_argc);
 
-void command_exec(struct command_base *cb, struct ast_node *command_node,
-		  struct symbol_table *sym_table, struct error **err);
-
-bool command_exists(struct command_base *cb, const char *name);
-bool subcommand_exists(struct command_base *cb, const char *name);
+void command_exec(struct ast_node *command_node, struct frame *frame,
+		  struct error **err);
 
-struct command command_get(struct command_base *cb, const char *name);
-struct command subcommand_get(struct command_base *cb, const char *name);
+/*
+ * name does not need to be NUL terminated, NULL if nothing is registered.
+ * A name registered as both is a command.
+ */
+const struct command *command_lookup(const struct command_base *cb,
+				     const char *name, size_t len,
+				     bool *subcommand);
 
 #endif
@@ -1,259 +1,187 @@
 #include "ast.h"
 #include "error.h"
-#include "symbol_table.h"
+#include "command.h"
 #include "command_funcs.h"
+#include "arithmetic.h"
+#include "output.h"
+#include "string_heap.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
-#include <inttypes.h>
 #include <limits.h>
-#include <errno.h>
 #include <assert.h>
+#include <stdbool.h>
 
-struct sym_val_data {
-	enum SYMBOL_TYPE type;
-	union symbol_val val;
-};
-
-static char *num_to_str(struct sym_val_data x);
-static char *int_to_str(int x);
-static char *double_to_str(double x);
 static bool is_literal(const struct ast_node *node);
-static bool is_identifier(const struct ast_node *node);
-static bool is_num(enum SYMBOL_TYPE type);
-static const char *parse_sym_val(const struct symbol *sym);
-static enum SYMBOL_TYPE tok_to_sym_type(const struct token tok);
-static struct sym_val_data tok_to_sym_val(struct symbol_table *sym_table,
-					  const struct token tok,
-					  struct error **err);
-static struct symbol *get_sym(struct symbol_table *sym_table,
-			      const struct token tok, struct error **err);
-static struct sym_val_data do_arithmetic(struct token tok,
-					 const struct sym_val_data x,
-					 const struct sym_val_data y);
-static int do_int_arithmetic(struct token tok, int x, int y);
-static double do_double_arithmetic(struct token tok, double x, double y);
+static bool convert_value(struct value *x, struct value like);
+static struct value node_to_value(const struct frame *frame,
+				  const struct ast_node *node);
+static struct value tok_to_value(const struct frame *frame,
+				 const struct ast_node *node);
+static bool eval_operands(struct ast_node *command_node, struct frame *frame,
+			  struct value *x, struct value *y, struct error **err);
+
+void command_func_create(struct ast_node *command_node, struct frame *frame,
+			 struct error **err)
+{
+	(void)err; // The resolver already rejected duplicates
+	struct value val = node_to_value(frame, command_node->args[1]);
+	value_retain(val);
+	frame->slots[command_node->args[0]->slot] = val;
+}
+
+void command_func_print(struct ast_node *command_node, struct frame *frame,
+			struct error **err)
+{
+	(void)err; // Printing can not fail
+	struct ast_node *arg = command_node->args[0];
+	if (is_literal(arg)) {
+		output_str(ast_node_str(arg));
+	} else {
+		output_value(node_to_value(frame, arg));
+	}
+	output_char('\n');
+}
 
-void command_func_create(struct ast_node *command_node,
-			 struct symbol_table *sym_table, struct error **err)
+void command_func_set(struct ast_node *command_node, struct frame *frame,
+		      struct error **err)
 {
-	const char *identifier = command_node->args[0]->tok.value;
-	enum SYMBOL_TYPE sym_type = tok_to_sym_type(command_node->args[1]->tok);
+	struct value val = node_to_value(frame, command_node->args[1]);
 
-	struct sym_val_data sym_val =
-		tok_to_sym_val(sym_table, command_node->args[1]->tok, err);
-	if (*err != NULL) {
+	// Variables keep the type they were created with
+	struct value *var = &frame->slots[command_node->args[0]->slot];
+	if (!convert_value(&val, *var)) {
+		*err = error_create(
+			ERROR_INTERPRETER, ERROR_RUNTIME_ERROR,
+			command_node->pos.line, command_node->pos.column,
+			"Can not assign a value of a different type to a variable");
 		return;
 	}
 
-	symbol_table_insert(
-		sym_table, identifier, sym_type, sym_val.val,
-		(struct symbol_call_data){ command_node->args[0]->tok.line,
-					   command_node->args[0]->tok.column },
-		err);
+	// Retained first, the variable may already hold the same string
+	value_retain(val);
+	value_release(*var);
+	*var = val;
 }
 
-void command_func_print(struct ast_node *command_node,
-			struct symbol_table *sym_table, struct error **err)
+void subcommand_func_add(struct ast_node *command_node, struct frame *frame,
+			 struct error **err)
 {
-	if (is_literal(command_node->args[0])) {
-		printf("%s\n", command_node->args[0]->tok.value);
-	} else if (is_identifier(command_node->args[0])) {
-		struct symbol *var =
-			get_sym(sym_table, command_node->args[0]->tok, err);
-		if (var == NULL) {
-			return;
-		}
+	struct value x, y;
+	if (!eval_operands(command_node, frame, &x, &y, err)) {
+		return;
+	}
 
-		printf("%s\n", parse_sym_val(var));
+	if (arith_is_int(x, y)) {
+		command_node->result = value_int(
+			arith_int_add(value_as_int(x), value_as_int(y)));
+	} else {
+		command_node->result = value_double(arith_to_double(x) +
+						    arith_to_double(y));
 	}
 }
 
-void command_func_set(struct ast_node *command_node,
-		      struct symbol_table *sym_table, struct error **err)
+void subcommand_func_sub(struct ast_node *command_node, struct frame *frame,
+			 struct error **err)
 {
-	const char *identifier = command_node->args[0]->tok.value;
-
-	struct sym_val_data sym_val =
-		tok_to_sym_val(sym_table, command_node->args[1]->tok, err);
-	if (*err != NULL) {
+	struct value x, y;
+	if (!eval_operands(command_node, frame, &x, &y, err)) {
 		return;
 	}
 
-	symbol_table_change(
-		sym_table, identifier, sym_val.val,
-		(struct symbol_call_data){ command_node->tok.line,
-					   command_node->tok.column },
-		err);
+	if (arith_is_int(x, y)) {
+		command_node->result = value_int(
+			arith_int_sub(value_as_int(x), value_as_int(y)));
+	} else {
+		command_node->result = value_double(arith_to_double(x) -
+						    arith_to_double(y));
+	}
 }
 
-void subcommand_func_arithmetic(struct ast_node *command_node,
-				struct symbol_table *sym_table,
-				struct error **err)
+void subcommand_func_mul(struct ast_node *command_node, struct frame *frame,
+			 struct error **err)
 {
-	struct token tok = {
-		.type = TOKEN_INT,
-		.line = command_node->tok.line,
-		.column = command_node->tok.column,
-	};
-
-	struct token left = command_node->args[0]->tok;
-	struct token right = command_node->args[1]->tok;
-
-	struct sym_val_data left_val = tok_to_sym_val(sym_table, left, err);
-	struct sym_val_data right_val = tok_to_sym_val(sym_table, right, err);
-	if (*err != NULL) {
+	struct value x, y;
+	if (!eval_operands(command_node, frame, &x, &y, err)) {
 		return;
 	}
 
-	if (is_num(left_val.type)) {
-		if (is_num(right_val.type)) {
-			struct sym_val_data sum = do_arithmetic(
-				command_node->tok, left_val, right_val);
-			char *str = num_to_str(sum);
-			assert(strcmp(str, "") != 0);
-
-			tok.value = str;
-			for (char *c = str; *c != '\0'; ++c) {
-				if (*c == '.') {
-					tok.type = TOKEN_DOUBLE;
-					break;
-				}
-			}
-		}
+	if (arith_is_int(x, y)) {
+		command_node->result = value_int(
+			arith_int_mul(value_as_int(x), value_as_int(y)));
+	} else {
+		command_node->result = value_double(arith_to_double(x) *
+						    arith_to_double(y));
 	}
-
-	command_node->tok = tok;
 }
 
-static struct sym_val_data do_arithmetic(struct token tok,
-					 const struct sym_val_data x,
-					 const struct sym_val_data y)
+void subcommand_func_div(struct ast_node *command_node, struct frame *frame,
+			 struct error **err)
 {
-	bool double_arithmetic = false;
-	double x_d = 0.0;
-	double y_d = 0.0;
-	int x_i = 0;
-	int y_i = 0;
-	if (x.type == SYMBOL_DOUBLE) {
-		x_d = x.val.double_val;
-		if (y.type == SYMBOL_DOUBLE) {
-			y_d = y.val.double_val;
-		} else {
-			y_d = (double)y.val.int_val;
-		}
-		double_arithmetic = true;
-	} else if (y.type == SYMBOL_DOUBLE) {
-		y_d = y.val.double_val;
-		x_d = (double)x.val.int_val;
-		double_arithmetic = true;
-	} else {
-		x_i = x.val.int_val;
-		y_i = y.val.int_val;
-		double_arithmetic = false;
+	struct value x, y;
+	if (!eval_operands(command_node, frame, &x, &y, err)) {
+		return;
 	}
 
-	if (double_arithmetic) {
-		double res = do_double_arithmetic(tok, x_d, y_d);
-		return (struct sym_val_data){ .type = SYMBOL_DOUBLE,
-					      .val = (union symbol_val){
-						      .double_val = res } };
+	if (arith_is_int(x, y)) {
+		if (value_as_int(y) == 0) {
+			*err = error_create(ERROR_INTERPRETER,
+					    ERROR_RUNTIME_ERROR,
+					    command_node->pos.line,
+					    command_node->pos.column,
+					    "Division by zero");
+			return;
+		}
+		command_node->result = value_int(
+			arith_int_div(value_as_int(x), value_as_int(y)));
 	} else {
-		int res = do_int_arithmetic(tok, x_i, y_i);
-		return (struct sym_val_data){ .type = SYMBOL_INT,
-					      .val = (union symbol_val){
-						      .int_val = res } };
+		command_node->result = value_double(arith_to_double(x) /
+						    arith_to_double(y));
 	}
 }
 
-static int do_int_arithmetic(struct token tok, int x, int y)
-{
-	if (strcmp(tok.value, "ADD") == 0) {
-		return x + y;
-	}
-	if (strcmp(tok.value, "SUB") == 0) {
-		return x - y;
-	}
-	if (strcmp(tok.value, "MUL") == 0) {
-		return x * y;
-	}
-	if (strcmp(tok.value, "DIV") == 0) {
-		return x / y;
-	}
-	return -1;
-}
-static double do_double_arithmetic(struct token tok, double x, double y)
+static bool eval_operands(struct ast_node *command_node, struct frame *frame,
+			  struct value *x, struct value *y, struct error **err)
 {
-	if (strcmp(tok.value, "ADD") == 0) {
-		return x + y;
-	}
-	if (strcmp(tok.value, "SUB") == 0) {
-		return x - y;
-	}
-	if (strcmp(tok.value, "MUL") == 0) {
-		return x * y;
-	}
-	if (strcmp(tok.value, "DIV") == 0) {
-		return x / y;
-	}
-	return -1;
-}
+	*x = node_to_value(frame, command_node->args[0]);
+	*y = node_to_value(frame, command_node->args[1]);
 
-static struct symbol *get_sym(struct symbol_table *sym_table,
-			      const struct token tok, struct error **err)
-{
-	return symbol_table_find(
-		sym_table, tok.value,
-		(struct symbol_call_data){ tok.line, tok.column }, err);
+	if (!arith_is_num(*x) || !arith_is_num(*y)) {
+		*err = error_create(ERROR_INTERPRETER, ERROR_RUNTIME_ERROR,
+				    command_node->pos.line,
+				    command_node->pos.column,
+				    "Can not do arithmetic on a string");
+		return false;
+	}
+	return true;
 }
 
-static enum SYMBOL_TYPE tok_to_sym_type(const struct token tok)
+static struct value node_to_value(const struct frame *frame,
+				  const struct ast_node *node)
 {
-	assert(tok.type == TOKEN_INT || tok.type == TOKEN_STR ||
-	       tok.type == TOKEN_DOUBLE);
-	switch (tok.type) {
-	case TOKEN_INT:
-		return SYMBOL_INT;
-	case TOKEN_STR:
-		return SYMBOL_STR;
-	case TOKEN_DOUBLE:
-		return SYMBOL_DOUBLE;
-	default: // For warnings
-		return SYMBOL_STR;
+	if (node->tok.type == TOKEN_SUBCOMMAND ||
+	    node->tok.type == TOKEN_CONSTANT) {
+		return node->result;
 	}
+	return tok_to_value(frame, node);
 }
 
-static struct sym_val_data tok_to_sym_val(struct symbol_table *sym_table,
-					  const struct token tok,
-					  struct error **err)
+static struct value tok_to_value(const struct frame *frame,
+				 const struct ast_node *node)
 {
+	const struct token tok = node->tok;
 	assert(tok.type == TOKEN_INT || tok.type == TOKEN_STR ||
 	       tok.type == TOKEN_IDENTIFIER || tok.type == TOKEN_DOUBLE);
 	if (tok.type == TOKEN_INT) {
-		intmax_t val = strtoimax(tok.value, NULL, 10);
-		if (val == INTMAX_MAX && errno == ERANGE) {
-			*err = error_create(
-				ERROR_INTERPRETER, ERROR_RUNTIME_ERROR,
-				tok.line, tok.column,
-				"Integer exceeds the max int limit");
-			return (struct sym_val_data){};
-		}
-		return (struct sym_val_data){ .type = SYMBOL_INT,
-					      .val = { .int_val = val } };
+		return value_int(tok.int_val);
 	}
 	if (tok.type == TOKEN_STR) {
-		return (struct sym_val_data){ .type = SYMBOL_STR,
-					      .val = { .str_val = tok.value } };
+		return value_str(node->string);
 	}
 	if (tok.type == TOKEN_DOUBLE) {
-		double val = strtod(tok.value, NULL);
-		return (struct sym_val_data){ .type = SYMBOL_DOUBLE,
-					      .val = { .double_val = val } };
+		return value_double(tok.double_val);
 	}
-	struct symbol *var = get_sym(sym_table, tok, err);
-	return (var != NULL) ? (struct sym_val_data){ .type = var->type,
-						      .val = var->value } :
-			       (struct sym_val_data){};
+	return frame->slots[node->slot];
 }
 
 static bool is_literal(const struct ast_node *node)
@@ -262,65 +190,20 @@ static bool is_literal(const struct ast_node *node)
 	       node->tok.type == TOKEN_DOUBLE;
 }
 
-static bool is_identifier(const struct ast_node *node)
-{
-	return node->tok.type == TOKEN_IDENTIFIER;
-}
-
-static const char *parse_sym_val(const struct symbol *sym)
-{
-	if (sym->type == SYMBOL_INT) {
-		const char *str = int_to_str(sym->value.int_val);
-		assert(strcmp(str, "") != 0);
-		return str;
-	}
-	if (sym->type == SYMBOL_DOUBLE) {
-		const char *str = double_to_str(sym->value.double_val);
-		assert(strcmp(str, "") != 0);
-		return str;
-	}
-	if (sym->type == SYMBOL_STR) {
-		return sym->value.str_val;
-	}
-	return "";
-}
-
-static char *num_to_str(struct sym_val_data x)
+// Converts x to the type of like, ints and doubles convert into each other
+static bool convert_value(struct value *x, struct value like)
 {
-	assert(x.type == SYMBOL_INT || x.type == SYMBOL_DOUBLE);
-	switch (x.type) {
-	case SYMBOL_INT:
-		return int_to_str(x.val.int_val);
-	case SYMBOL_DOUBLE:
-		return double_to_str(x.val.double_val);
-	default:
-		return "";
+	if (value_same_type(*x, like)) {
+		return true;
 	}
-}
-
-static char *int_to_str(int x)
-{
-	size_t length = snprintf(NULL, 0, "%d", x);
-	char *str = malloc(length + 1);
-	if (str == NULL) {
-		return "";
+	if (!arith_is_num(*x) || !arith_is_num(like)) {
+		return false;
 	}
-	snprintf(str, length + 1, "%d", x);
-	return str;
-}
 
-static char *double_to_str(double x)
-{
-	size_t length = snprintf(NULL, 0, "%f", x);
-	char *str = malloc(length + 1);
-	if (str == NULL) {
-		return "";
+	if (value_is_int(like)) {
+		*x = value_int(arith_to_int(value_as_double(*x)));
+	} else {
+		*x = value_double((double)value_as_int(*x));
 	}
-	snprintf(str, length + 1, "%f", x);
-	return str;
-}
-
-static bool is_num(enum SYMBOL_TYPE type)
-{
-	return type == SYMBOL_INT || type == SYMBOL_DOUBLE;
+	return true;
 }
@@ -2,18 +2,23 @@
 #define COMMAND_FUNCS_H
 
 struct ast_node;
-struct symbol_table;
+struct frame;
 struct error;
 
-void command_func_create(struct ast_node *command_node,
-			 struct symbol_table *sym_table, struct error **err);
-void command_func_print(struct ast_node *command_node,
-			struct symbol_table *sym_table, struct error **err);
-void command_func_set(struct ast_node *command_node,
-		      struct symbol_table *sym_table, struct error **err);
+void command_func_create(struct ast_node *command_node, struct frame *frame,
+			 struct error **err);
+void command_func_print(struct ast_node *command_node, struct frame *frame,
+			struct error **err);
+void command_func_set(struct ast_node *command_node, struct frame *frame,
+		      struct error **err);
 
-void subcommand_func_arithmetic(struct ast_node *command_node,
-				struct symbol_table *sym_table,
-				struct error **err);
+void subcommand_func_add(struct ast_node *command_node, struct frame *frame,
+			 struct error **err);
+void subcommand_func_sub(struct ast_node *command_node, struct frame *frame,
+			 struct error **err);
+void subcommand_func_mul(struct ast_node *command_node, struct frame *frame,
+			 struct error **err);
+void subcommand_func_div(struct ast_node *command_node, struct frame *frame,
+			 struct error **err);
 
 #endif
@@ -0,0 +1,280 @@
+#include "error.h"
+#include "ast.h"
+#include "command.h"
+#include "command_funcs.h"
+#include "resolver.h"
+#include "bytecode.h"
+#include "compiler.h"
+#include "string_heap.h"
+#include <string.h>
+#include <assert.h>
+
+struct compiler {
+	struct chunk *chunk;
+	size_t depth; // Depth of the value stack at the current instruction
+};
+
+// Opcodes for operands of any type, two ints and two doubles
+static const struct {
+	command_func func;
+	enum OPCODE op;
+	enum OPCODE int_op;
+	enum OPCODE double_op;
+} arithmetic_ops[] = {
+	{ subcommand_func_add, OP_ADD, OP_ADD_INT, OP_ADD_DOUBLE },
+	{ subcommand_func_sub, OP_SUB, OP_SUB_INT, OP_SUB_DOUBLE },
+	{ subcommand_func_mul, OP_MUL, OP_MUL_INT, OP_MUL_DOUBLE },
+	{ subcommand_func_div, OP_DIV, OP_DIV_INT, OP_DIV_DOUBLE },
+};
+
+static bool can_lower(const struct ast_node *statement);
+static bool arithmetic_op(command_func func, enum VALUE_TYPE type,
+			  enum OPCODE *op);
+static void compile_command(struct compiler *c, const struct ast_node *node);
+static void compile_create(struct compiler *c, const struct ast_node *node);
+static void compile_set(struct compiler *c, const struct ast_node *node);
+static void compile_print(struct compiler *c, const struct ast_node *node);
+static void compile_operand(struct compiler *c, const struct ast_node *node);
+static void compile_value(struct compiler *c, const struct ast_node *node);
+static void compile_literal(struct compiler *c, const struct ast_node *node);
+static void emit(struct compiler *c, enum OPCODE op, uint32_t arg,
+		 const struct ast_node *node);
+
+struct chunk *compile_ast(const struct ast_node *const ast,
+			  const struct resolution *res)
+{
+	struct compiler c = {
+		.chunk = chunk_create(),
+		.depth = 0,
+	};
+	c.chunk->slot_count = res->slot_count;
+
+	for (size_t i = 0; i < res->statement_count; ++i) {
+		compile_command(&c, ast->args[i]);
+	}
+
+	// The chunk keeps its own copy, the resolution is freed by the caller
+	if (res->err != NULL) {
+		c.chunk->err = error_create(res->err->type, res->err->code,
+					    res->err->line, res->err->column,
+					    "%s", res->err->message);
+		emit(&c, OP_FAIL, 0, ast->args[res->statement_count]);
+	}
+	emit(&c, OP_HALT, 0, ast);
+
+	return c.chunk;
+}
+
+// A statement with a command or subcommand that has no opcode is called
+static bool can_lower(const struct ast_node *statement)
+{
+	if (statement->func != command_func_create &&
+	    statement->func != command_func_set &&
+	    statement->func != command_func_print) {
+		return false;
+	}
+
+	struct ast_walk walk;
+	ast_walk_init(&walk, (struct ast_node *)statement);
+
+	bool lowered = true;
+	enum OPCODE op;
+	const struct ast_node *curr;
+	while (lowered && (curr = ast_walk_next(&walk)) != NULL) {
+		if (curr->tok.type == TOKEN_SUBCOMMAND) {
+			lowered = arithmetic_op(curr->func, VALUE_ANY, &op);
+		}
+	}
+
+	ast_walk_free(&walk);
+	return lowered;
+}
+
+// The type of the result picks the opcode, a double result of an int
+// operand has it converted first
+static bool arithmetic_op(command_func func, enum VALUE_TYPE type,
+			  enum OPCODE *op)
+{
+	for (size_t i = 0;
+	     i < sizeof(arithmetic_ops) / sizeof(arithmetic_ops[0]); ++i) {
+		if (func == arithmetic_ops[i].func) {
+			*op = type == VALUE_INT	   ? arithmetic_ops[i].int_op :
+			      type == VALUE_DOUBLE ? arithmetic_ops[i].double_op :
+						     arithmetic_ops[i].op;
+			return true;
+		}
+	}
+	return false;
+}
+
+static void compile_command(struct compiler *c, const struct ast_node *node)
+{
+	if (!can_lower(node)) {
+		uint32_t index =
+			chunk_add_node(c->chunk, (struct ast_node *)node);
+		emit(c, OP_CALL, index, node);
+	} else if (node->func == command_func_create) {
+		compile_create(c, node);
+	} else if (node->func == command_func_set) {
+		compile_set(c, node);
+	} else {
+		compile_print(c, node);
+	}
+}
+
+static void compile_create(struct compiler *c, const struct ast_node *node)
+{
+	const struct ast_node *identifier = node->args[0];
+
+	compile_operand(c, node->args[1]);
+	emit(c, OP_CREATE, identifier->slot, identifier);
+}
+
+static void compile_set(struct compiler *c, const struct ast_node *node)
+{
+	compile_operand(c, node->args[1]);
+
+	// Numbers of known types are converted here, not checked at runtime
+	enum VALUE_TYPE var = node->args[0]->type;
+	enum VALUE_TYPE value = node->args[1]->type;
+	if ((var == VALUE_INT || var == VALUE_DOUBLE) &&
+	    (value == VALUE_INT || value == VALUE_DOUBLE)) {
+		if (var != value) {
+			emit(c, var == VALUE_INT ? OP_TO_INT : OP_TO_DOUBLE, 0,
+			     node);
+		}
+		emit(c, OP_STORE, node->args[0]->slot, node);
+	} else {
+		emit(c, OP_SET, node->args[0]->slot, node);
+	}
+}
+
+static void compile_print(struct compiler *c, const struct ast_node *node)
+{
+	struct ast_node *arg = node->args[0];
+	enum TOKEN_TYPE type = arg->tok.type;
+
+	// Literals are printed exactly as they were written
+	if (type == TOKEN_INT || type == TOKEN_DOUBLE || type == TOKEN_STR) {
+		const char *str = ast_node_str(arg);
+		struct value text = value_str(string_intern(str, strlen(str)));
+		uint32_t index = chunk_add_constant(c->chunk, text);
+		value_release(text);
+		emit(c, OP_CONST, index, arg);
+	} else {
+		compile_operand(c, node->args[0]);
+	}
+
+	emit(c, OP_PRINT, 0, node);
+}
+
+// Emitted in post-order, each subcommand right after its operands
+static void compile_operand(struct compiler *c, const struct ast_node *node)
+{
+	struct ast_walk walk;
+	ast_walk_init(&walk, (struct ast_node *)node);
+
+	const struct ast_node *curr;
+	while ((curr = ast_walk_next(&walk)) != NULL) {
+		compile_value(c, curr);
+	}
+
+	ast_walk_free(&walk);
+}
+
+// An int operand of arithmetic with a double result
+static bool needs_double(const struct ast_node *node)
+{
+	return node->type == VALUE_INT &&
+	       node->parent->tok.type == TOKEN_SUBCOMMAND &&
+	       node->parent->type == VALUE_DOUBLE;
+}
+
+static void compile_value(struct compiler *c, const struct ast_node *node)
+{
+	switch (node->tok.type) {
+	case TOKEN_INT:
+	case TOKEN_DOUBLE:
+	case TOKEN_STR:
+		compile_literal(c, node);
+		return;
+	case TOKEN_IDENTIFIER:
+		emit(c, OP_LOAD, node->slot, node);
+		break;
+	case TOKEN_CONSTANT: {
+		struct value val = node->result;
+		if (needs_double(node)) {
+			val = value_double(value_as_int(val));
+		}
+		emit(c, OP_CONST, chunk_add_constant(c->chunk, val), node);
+		return;
+	}
+	default: {
+		// The resolver only lets values through
+		assert(node->tok.type == TOKEN_SUBCOMMAND);
+
+		// can_lower already found an opcode for every subcommand
+		enum OPCODE op = OP_HALT;
+		arithmetic_op(node->func, node->type, &op);
+		assert(op != OP_HALT);
+		emit(c, op, 0, node);
+		break;
+	}
+	}
+
+	if (needs_double(node)) {
+		emit(c, OP_TO_DOUBLE, 0, node);
+	}
+}
+
+static void compile_literal(struct compiler *c, const struct ast_node *node)
+{
+	struct value val;
+	if (node->tok.type == TOKEN_INT && needs_double(node)) {
+		val = value_double(node->tok.int_val);
+	} else if (node->tok.type == TOKEN_INT) {
+		val = value_int(node->tok.int_val);
+	} else if (node->tok.type == TOKEN_DOUBLE) {
+		val = value_double(node->tok.double_val);
+	} else {
+		val = value_str(node->string);
+	}
+
+	emit(c, OP_CONST, chunk_add_constant(c->chunk, val), node);
+}
+
+static void emit(struct compiler *c, enum OPCODE op, uint32_t arg,
+		 const struct ast_node *node)
+{
+	chunk_emit(c->chunk, op, arg, node->pos);
+
+	switch (op) {
+	case OP_CONST:
+	case OP_LOAD:
+		if (++c->depth > c->chunk->max_stack) {
+			c->chunk->max_stack = c->depth;
+		}
+		break;
+	case OP_CREATE:
+	case OP_SET:
+	case OP_STORE:
+	case OP_PRINT:
+	case OP_ADD:
+	case OP_SUB:
+	case OP_MUL:
+	case OP_DIV:
+	case OP_ADD_INT:
+	case OP_SUB_INT:
+	case OP_MUL_INT:
+	case OP_DIV_INT:
+	case OP_ADD_DOUBLE:
+	case OP_SUB_DOUBLE:
+	case OP_MUL_DOUBLE:
+	case OP_DIV_DOUBLE:
+		assert(c->depth > 0);
+		--c->depth;
+		break;
+	default:
+		break;
+	}
+}
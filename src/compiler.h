@@ -0,0 +1,16 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+
+struct ast_node;
+struct chunk;
+struct resolution;
+
+/*
+ * Lowers a resolved program into bytecode. Programs are straight-line code,
+ * so an error found before running becomes an OP_FAIL at the statement that
+ * would have raised it, output of the statements before it is kept.
+ */
+struct chunk *compile_ast(const struct ast_node *const ast,
+			  const struct resolution *res);
+
+#endif
@@ -0,0 +1,612 @@
+#include "error.h"
+#include "ast.h"
+#include "command_funcs.h"
+#include "resolver.h"
+#include "string_heap.h"
+#include "emit_c.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#define INITIAL_OPERANDS_SIZE 16
+
+enum C_TYPE { C_INT, C_DOUBLE, C_STR };
+
+static const char *const c_type_names[] = {
+	[C_INT] = "int",
+	[C_DOUBLE] = "double",
+	[C_STR] = "struct duc_str",
+};
+
+enum C_HELPER {
+	HELPER_PRINT_INT,
+	HELPER_PRINT_DOUBLE,
+	HELPER_PRINT_STR,
+	HELPER_FAIL,
+	HELPER_BITS,
+	HELPER_TO_INT,
+	HELPER_ADD,
+	HELPER_SUB,
+	HELPER_MUL,
+	HELPER_DIV, // Calls duc_fail
+	HELPER_COUNT,
+};
+
+// A leaf node written in place or a temporary holding a subcommand result
+struct c_operand {
+	enum C_TYPE type;
+	const struct ast_node *node; // NULL for a temporary
+	size_t temp;
+};
+
+struct emitter {
+	FILE *out;
+	enum C_TYPE *types; // Of every created variable, by slot
+	size_t slot_count;
+	struct c_operand *operands; // Stack of evaluated operands
+	size_t length;
+	size_t capacity;
+	size_t temp_count;
+	bool *unread; // Created variables that were not read yet, by slot
+	bool uses[HELPER_COUNT]; // Helpers the program calls
+
+	bool stopped; // An error was emitted, nothing after it can run
+	struct error *err; // The program can not be transpiled
+};
+
+// What every program needs to write its output
+static const char prelude[] =
+	"#include <float.h>\n"
+	"#include <stdio.h>\n"
+	"#include <stdlib.h>\n"
+	"#include <string.h>\n"
+	"\n"
+	"struct duc_str {\n"
+	"\tconst char *data;\n"
+	"\tsize_t length;\n"
+	"};\n"
+	"\n"
+	"#define DUC_STR(s) ((struct duc_str){ s, sizeof(s) - 1 })\n"
+	"\n"
+	"static char duc_buffer[65536];\n"
+	"static size_t duc_length;\n"
+	"\n"
+	"static inline void duc_flush(void)\n"
+	"{\n"
+	"\tfwrite(duc_buffer, 1, duc_length, stdout);\n"
+	"\tfflush(stdout);\n"
+	"\tduc_length = 0;\n"
+	"}\n"
+	"\n"
+	"static inline void duc_write(const char *data, size_t len)\n"
+	"{\n"
+	"\tif (len > sizeof(duc_buffer) - duc_length) {\n"
+	"\t\tduc_flush();\n"
+	"\t\tif (len > sizeof(duc_buffer)) {\n"
+	"\t\t\tfwrite(data, 1, len, stdout);\n"
+	"\t\t\treturn;\n"
+	"\t\t}\n"
+	"\t}\n"
+	"\tmemcpy(duc_buffer + duc_length, data, len);\n"
+	"\tduc_length += len;\n"
+	"}\n";
+
+// Output and arithmetic of the interpreter, only the used ones are written
+static const char *const helpers[] = {
+	[HELPER_PRINT_INT] =
+		"static inline void duc_print_int(int x)\n"
+		"{\n"
+		"\tchar buf[16];\n"
+		"\tduc_write(buf, snprintf(buf, sizeof(buf), \"%d\\n\", x));\n"
+		"}\n",
+	[HELPER_PRINT_DOUBLE] =
+		"static inline void duc_print_double(double x)\n"
+		"{\n"
+		"\t// -DBL_MAX, six decimals, a newline and the NUL\n"
+		"\tchar buf[DBL_MAX_10_EXP + 11];\n"
+		"\tduc_write(buf, snprintf(buf, sizeof(buf), \"%f\\n\", x));\n"
+		"}\n",
+	[HELPER_PRINT_STR] =
+		"static inline void duc_print_str(struct duc_str x)\n"
+		"{\n"
+		"\tduc_write(x.data, x.length);\n"
+		"\tduc_write(\"\\n\", 1);\n"
+		"}\n",
+	[HELPER_FAIL] =
+		"static inline void duc_fail(const char *message)\n"
+		"{\n"
+		"\tduc_flush();\n"
+		"\tfputs(message, stderr);\n"
+		"\tfputs(\"ERROR Interpreting: Failed to interpret the code \"\n"
+		"\t      \"exit code: 1\\n\", stderr);\n"
+		"\texit(1);\n"
+		"}\n",
+	[HELPER_BITS] =
+		"static inline double duc_bits(unsigned long long bits)\n"
+		"{\n"
+		"\tdouble x;\n"
+		"\tmemcpy(&x, &bits, sizeof(x));\n"
+		"\treturn x;\n"
+		"}\n",
+	[HELPER_TO_INT] =
+		"// NaN and doubles out of the int range give INT_MIN\n"
+		"static inline int duc_to_int(double x)\n"
+		"{\n"
+		"\tif (!(x > -2147483649.0 && x < 2147483648.0)) {\n"
+		"\t\treturn -2147483647 - 1;\n"
+		"\t}\n"
+		"\treturn (int)x;\n"
+		"}\n",
+	[HELPER_ADD] =
+		"static inline int duc_add(int x, int y)\n"
+		"{\n"
+		"\treturn (int)((unsigned int)x + (unsigned int)y);\n"
+		"}\n",
+	[HELPER_SUB] =
+		"static inline int duc_sub(int x, int y)\n"
+		"{\n"
+		"\treturn (int)((unsigned int)x - (unsigned int)y);\n"
+		"}\n",
+	[HELPER_MUL] =
+		"static inline int duc_mul(int x, int y)\n"
+		"{\n"
+		"\treturn (int)((unsigned int)x * (unsigned int)y);\n"
+		"}\n",
+	[HELPER_DIV] =
+		"static inline int duc_div(int x, int y, "
+		"const char *division_by_zero)\n"
+		"{\n"
+		"\tif (y == 0) {\n"
+		"\t\tduc_fail(division_by_zero);\n"
+		"\t}\n"
+		"\tif (y == -1) {\n"
+		"\t\treturn (int)(0u - (unsigned int)x);\n"
+		"\t}\n"
+		"\treturn x / y;\n"
+		"}\n",
+};
+
+// Escapes bytes that can not appear as they are in a C string literal
+static void write_c_string(FILE *out, const char *data, size_t len)
+{
+	fputc('"', out);
+	for (size_t i = 0; i < len; ++i) {
+		unsigned char c = data[i];
+		if (c == '"' || c == '\\') {
+			fprintf(out, "\\%c", c);
+		} else if (c == '\n') {
+			fputs("\\n", out);
+		} else if (c == '\t') {
+			fputs("\\t", out);
+		} else if (c < 0x20 || c >= 0x7F || c == '?') {
+			// Three octal digits never run into the next character
+			fprintf(out, "\\%03o", c);
+		} else {
+			fputc(c, out);
+		}
+	}
+	fputc('"', out);
+}
+
+// The whole line error_print would write for err
+static char *format_error(const struct error *err, size_t *len)
+{
+	int n = snprintf(NULL, 0, "%s at line %zu, column %zu: %s\n",
+			 error_type_str(err->type), err->line, err->column,
+			 err->message);
+	char *line = malloc(n + 1);
+	assert(line != NULL);
+	snprintf(line, n + 1, "%s at line %zu, column %zu: %s\n",
+		 error_type_str(err->type), err->line, err->column,
+		 err->message);
+	*len = n;
+	return line;
+}
+
+static void write_error(FILE *out, const struct error *err)
+{
+	size_t len;
+	char *line = format_error(err, &len);
+	write_c_string(out, line, len);
+	free(line);
+}
+
+// Reads what would otherwise be an unused variable
+static void emit_discard(struct emitter *e, struct c_operand op)
+{
+	if (op.node == NULL) {
+		fprintf(e->out, "\t(void)t%zu;\n", op.temp);
+	}
+}
+
+static void emit_discard_unread(struct emitter *e)
+{
+	for (size_t i = 0; i <= e->slot_count; ++i) {
+		if (e->unread[i]) {
+			fprintf(e->out, "\t(void)v%zu;\n", i);
+			e->unread[i] = false;
+		}
+	}
+}
+
+static void emit_error(struct emitter *e, const struct error *err)
+{
+	for (size_t i = 0; i < e->length; ++i) {
+		emit_discard(e, e->operands[i]);
+	}
+	emit_discard_unread(e);
+	e->uses[HELPER_FAIL] = true;
+	fputs("\tduc_fail(", e->out);
+	write_error(e->out, err);
+	fputs(");\n", e->out);
+	e->stopped = true;
+}
+
+static void emit_runtime_error(struct emitter *e, const struct ast_node *node,
+			       const char *message)
+{
+	struct error *err = error_create(ERROR_INTERPRETER,
+					 ERROR_RUNTIME_ERROR, node->pos.line,
+					 node->pos.column, "%s", message);
+	emit_error(e, err);
+	error_free(err);
+}
+
+static void write_int(FILE *out, int x)
+{
+	if (x == -2147483647 - 1) {
+		fputs("(-2147483647 - 1)", out);
+	} else if (x < 0) {
+		fprintf(out, "(%d)", x);
+	} else {
+		fprintf(out, "%d", x);
+	}
+}
+
+// Hexadecimal floats are exact, NaNs and infinities are written as bits
+static void write_double(struct emitter *e, double x)
+{
+	if (isfinite(x)) {
+		fprintf(e->out, "(%a)", x);
+	} else {
+		e->uses[HELPER_BITS] = true;
+		fprintf(e->out, "duc_bits(0x%016llxull)",
+			(unsigned long long)value_double(x).bits);
+	}
+}
+
+static void write_operand(struct emitter *e, struct c_operand op)
+{
+	const struct ast_node *node = op.node;
+	if (node == NULL) {
+		fprintf(e->out, "t%zu", op.temp);
+		return;
+	}
+
+	switch (node->tok.type) {
+	case TOKEN_INT:
+		write_int(e->out, node->tok.int_val);
+		break;
+	case TOKEN_DOUBLE:
+		write_double(e, node->tok.double_val);
+		break;
+	case TOKEN_STR:
+		fputs("DUC_STR(", e->out);
+		write_c_string(e->out, node->string->data,
+			       node->string->length);
+		fputc(')', e->out);
+		break;
+	case TOKEN_CONSTANT:
+		if (value_is_int(node->result)) {
+			write_int(e->out, value_as_int(node->result));
+		} else {
+			write_double(e, value_as_double(node->result));
+		}
+		break;
+	default:
+		e->unread[node->slot] = false;
+		fprintf(e->out, "v%u", node->slot);
+		break;
+	}
+}
+
+// Writes op as a double, ints are converted like arith_to_double
+static void write_double_operand(struct emitter *e, struct c_operand op)
+{
+	if (op.type == C_INT) {
+		fputs("(double)", e->out);
+	}
+	write_operand(e, op);
+}
+
+static void push_operand(struct emitter *e, struct c_operand op)
+{
+	if (e->length == e->capacity) {
+		e->capacity *= 2;
+		e->operands = realloc(e->operands,
+				      sizeof(*e->operands) * e->capacity);
+		assert(e->operands != NULL);
+	}
+	e->operands[e->length++] = op;
+}
+
+static const struct {
+	command_func func;
+	enum C_HELPER int_helper;
+	const char *int_func;
+	char double_op;
+} arithmetic_ops[] = {
+	{ subcommand_func_add, HELPER_ADD, "duc_add", '+' },
+	{ subcommand_func_sub, HELPER_SUB, "duc_sub", '-' },
+	{ subcommand_func_mul, HELPER_MUL, "duc_mul", '*' },
+	{ subcommand_func_div, HELPER_DIV, "duc_div", '/' },
+};
+
+static void emit_subcommand(struct emitter *e, const struct ast_node *node)
+{
+	size_t i = 0;
+	while (i < sizeof(arithmetic_ops) / sizeof(arithmetic_ops[0]) &&
+	       arithmetic_ops[i].func != node->func) {
+		++i;
+	}
+	if (i == sizeof(arithmetic_ops) / sizeof(arithmetic_ops[0])) {
+		e->err = error_create(ERROR_INTERPRETER, ERROR_RUNTIME_ERROR,
+				      node->pos.line, node->pos.column,
+				      "Subcommand '%s' can not be transpiled",
+				      node->tok.command->command_name);
+		return;
+	}
+
+	struct c_operand y = e->operands[e->length - 1];
+	struct c_operand x = e->operands[e->length - 2];
+	if (x.type == C_STR || y.type == C_STR) {
+		emit_runtime_error(e, node, "Can not do arithmetic on a string");
+		return;
+	}
+	e->length -= 2;
+
+	struct c_operand result = { .node = NULL, .temp = e->temp_count++ };
+	if (x.type == C_INT && y.type == C_INT) {
+		result.type = C_INT;
+		e->uses[arithmetic_ops[i].int_helper] = true;
+		if (node->func == subcommand_func_div) {
+			e->uses[HELPER_FAIL] = true;
+		}
+		fprintf(e->out, "\tint t%zu = %s(", result.temp,
+			arithmetic_ops[i].int_func);
+		write_operand(e, x);
+		fputs(", ", e->out);
+		write_operand(e, y);
+		if (node->func == subcommand_func_div) {
+			struct error *err = error_create(
+				ERROR_INTERPRETER, ERROR_RUNTIME_ERROR,
+				node->pos.line, node->pos.column,
+				"Division by zero");
+			fputs(", ", e->out);
+			write_error(e->out, err);
+			error_free(err);
+		}
+		fputs(");\n", e->out);
+	} else {
+		result.type = C_DOUBLE;
+		fprintf(e->out, "\tdouble t%zu = ", result.temp);
+		write_double_operand(e, x);
+		fprintf(e->out, " %c ", arithmetic_ops[i].double_op);
+		write_double_operand(e, y);
+		fputs(";\n", e->out);
+	}
+	push_operand(e, result);
+}
+
+// Subcommands are written in post-order, each after its operands
+static bool emit_value(struct emitter *e, struct ast_node *node,
+		       struct c_operand *result)
+{
+	struct ast_walk walk;
+	ast_walk_init(&walk, node);
+
+	struct ast_node *curr;
+	while (!e->stopped && e->err == NULL &&
+	       (curr = ast_walk_next(&walk)) != NULL) {
+		struct c_operand op = { .node = curr };
+		switch (curr->tok.type) {
+		case TOKEN_INT:
+			op.type = C_INT;
+			break;
+		case TOKEN_DOUBLE:
+			op.type = C_DOUBLE;
+			break;
+		case TOKEN_STR:
+			op.type = C_STR;
+			break;
+		case TOKEN_CONSTANT:
+			op.type = value_is_int(curr->result) ? C_INT :
+							       C_DOUBLE;
+			break;
+		case TOKEN_IDENTIFIER:
+			op.type = e->types[curr->slot];
+			break;
+		default:
+			emit_subcommand(e, curr);
+			continue;
+		}
+		push_operand(e, op);
+	}
+
+	ast_walk_free(&walk);
+	if (e->stopped || e->err != NULL) {
+		e->length = 0;
+		return false;
+	}
+	*result = e->operands[--e->length];
+	return true;
+}
+
+static void emit_create(struct emitter *e, const struct ast_node *node)
+{
+	const struct ast_node *identifier = node->args[0];
+	struct c_operand value;
+	if (!emit_value(e, node->args[1], &value)) {
+		return;
+	}
+
+	e->types[identifier->slot] = value.type;
+	e->unread[identifier->slot] = true;
+	fprintf(e->out, "\t%s v%u = ", c_type_names[value.type],
+		identifier->slot);
+	write_operand(e, value);
+	fprintf(e->out, "; // %s\n", identifier->string->data);
+}
+
+// Variables keep the type they were created with
+static void emit_set(struct emitter *e, const struct ast_node *node)
+{
+	struct c_operand value;
+	if (!emit_value(e, node->args[1], &value)) {
+		return;
+	}
+
+	uint32_t slot = node->args[0]->slot;
+	enum C_TYPE type = e->types[slot];
+	if ((type == C_STR) != (value.type == C_STR)) {
+		emit_discard(e, value);
+		emit_runtime_error(
+			e, node,
+			"Can not assign a value of a different type to a variable");
+		return;
+	}
+
+	fprintf(e->out, "\tv%u = ", slot);
+	if (type == C_INT && value.type == C_DOUBLE) {
+		e->uses[HELPER_TO_INT] = true;
+		fputs("duc_to_int(", e->out);
+		write_operand(e, value);
+		fputs(")", e->out);
+	} else if (type == C_DOUBLE) {
+		write_double_operand(e, value);
+	} else {
+		write_operand(e, value);
+	}
+	fputs(";\n", e->out);
+}
+
+static void emit_print(struct emitter *e, const struct ast_node *node)
+{
+	struct ast_node *arg = node->args[0];
+	enum TOKEN_TYPE type = arg->tok.type;
+
+	// Literals are printed exactly as they were written
+	if (type == TOKEN_INT || type == TOKEN_DOUBLE || type == TOKEN_STR) {
+		const char *str = ast_node_str(arg);
+		size_t len = strlen(str);
+		char *line = malloc(len + 2);
+		assert(line != NULL);
+		memcpy(line, str, len);
+		line[len] = '\n';
+
+		fputs("\tduc_write(", e->out);
+		write_c_string(e->out, line, len + 1);
+		fprintf(e->out, ", %zu);\n", len + 1);
+		free(line);
+		return;
+	}
+
+	struct c_operand value;
+	if (!emit_value(e, arg, &value)) {
+		return;
+	}
+	static const enum C_HELPER print_helpers[] = {
+		[C_INT] = HELPER_PRINT_INT,
+		[C_DOUBLE] = HELPER_PRINT_DOUBLE,
+		[C_STR] = HELPER_PRINT_STR,
+	};
+	e->uses[print_helpers[value.type]] = true;
+	fprintf(e->out, "\tduc_print_%s(",
+		value.type == C_INT    ? "int" :
+		value.type == C_DOUBLE ? "double" :
+					 "str");
+	write_operand(e, value);
+	fputs(");\n", e->out);
+}
+
+static void emit_statement(struct emitter *e, struct ast_node *node)
+{
+	if (node->func == command_func_create) {
+		emit_create(e, node);
+	} else if (node->func == command_func_set) {
+		emit_set(e, node);
+	} else if (node->func == command_func_print) {
+		emit_print(e, node);
+	} else {
+		e->err = error_create(ERROR_INTERPRETER, ERROR_RUNTIME_ERROR,
+				      node->pos.line, node->pos.column,
+				      "Command '%s' can not be transpiled",
+				      node->tok.command->command_name);
+	}
+}
+
+enum EXT_CODE emit_c(const struct ast_node *const ast,
+		     const struct resolution *res, const char *filename)
+{
+	// main is written first to know which helpers go before it
+	char *body;
+	size_t body_length;
+	struct emitter e = {
+		.out = open_memstream(&body, &body_length),
+		.types = calloc(res->slot_count + 1, sizeof(enum C_TYPE)),
+		.slot_count = res->slot_count,
+		.operands = malloc(sizeof(struct c_operand) *
+				   INITIAL_OPERANDS_SIZE),
+		.length = 0,
+		.capacity = INITIAL_OPERANDS_SIZE,
+		.temp_count = 0,
+		.unread = calloc(res->slot_count + 1, sizeof(bool)),
+		.uses = { false },
+		.stopped = false,
+		.err = NULL,
+	};
+	assert(e.out != NULL && e.types != NULL && e.operands != NULL &&
+	       e.unread != NULL);
+
+	for (size_t i = 0; i < res->statement_count && !e.stopped; ++i) {
+		emit_statement(&e, ast->args[i]);
+		if (e.err != NULL) {
+			break;
+		}
+	}
+	if (!e.stopped && e.err == NULL && res->err != NULL) {
+		emit_error(&e, res->err);
+	}
+	if (!e.stopped) {
+		emit_discard_unread(&e);
+	}
+	fclose(e.out);
+
+	fputs("// Generated from ", stdout);
+	write_c_string(stdout, filename, strlen(filename));
+	fputs(", build without -ffast-math to keep doubles exact\n", stdout);
+	fputs(prelude, stdout);
+	for (size_t i = 0; i < HELPER_COUNT; ++i) {
+		if (e.uses[i]) {
+			fputc('\n', stdout);
+			fputs(helpers[i], stdout);
+		}
+	}
+	fputs("\nint main(void)\n{\n", stdout);
+	fwrite(body, 1, body_length, stdout);
+	fputs("\tduc_flush();\n\treturn 0;\n}\n", stdout);
+	free(body);
+
+	enum EXT_CODE result = EXT_SUCCESS;
+	if (e.err != NULL) {
+		error_print(e.err);
+		error_free(e.err);
+		result = EXT_FAIL;
+	}
+	free(e.types);
+	free(e.unread);
+	free(e.operands);
+	return result;
+}
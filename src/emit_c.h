@@ -0,0 +1,19 @@
+#ifndef EMIT_C_H
+#define EMIT_C_H
+
+#include "interpreter.h"
+
+struct ast_node;
+struct resolution;
+
+/*
+ * Writes a resolved and folded program to stdout as a C translation unit
+ * that does what running it would do. A variable keeps the type it was
+ * created with, so every variable is a typed local and every subcommand a
+ * native expression. Operations that can only fail become the error they
+ * raise, which then ends the program.
+ */
+enum EXT_CODE emit_c(const struct ast_node *const ast,
+		     const struct resolution *res, const char *filename);
+
+#endif
@@ -1,4 +1,5 @@
 #include "error.h"
+#include "output.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
@@ -36,30 +37,30 @@ struct error *error_create(enum ERROR_TYPE type, enum ERROR_CODE code,
 	return err;
 }
 
-void error_print(const struct error *err)
+const char *error_type_str(enum ERROR_TYPE type)
 {
-	const char *type_str;
-
-	if (!err)
-		return;
-
-	switch (err->type) {
+	switch (type) {
 	case ERROR_LEXER:
-		type_str = "Lexer Error";
-		break;
+		return "Lexer Error";
 	case ERROR_PARSER:
-		type_str = "Parser Error";
-		break;
+		return "Parser Error";
 	case ERROR_INTERPRETER:
-		type_str = "Interpreter Error";
-		break;
+		return "Interpreter Error";
 	default:
-		type_str = "Unknown Error";
-		break;
+		return "Unknown Error";
 	}
+}
+
+void error_print(const struct error *err)
+{
+	if (!err)
+		return;
 
-	fprintf(stderr, "%s at line %zu, column %zu: %s\n", type_str, err->line,
-		err->column, err->message);
+	// Output of the program comes before the error that stopped it
+	output_flush();
+	fprintf(stderr, "%s at line %zu, column %zu: %s\n",
+		error_type_str(err->type), err->line, err->column,
+		err->message);
 }
 
 void error_free(struct error *err)
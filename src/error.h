@@ -24,6 +24,9 @@ struct error {
 struct error *error_create(enum ERROR_TYPE type, enum ERROR_CODE code,
 			   size_t line, size_t column, const char *format, ...);
 
+// "Lexer Error", "Parser Error" or "Interpreter Error"
+const char *error_type_str(enum ERROR_TYPE type);
+
 void error_print(const struct error *err);
 
 void error_free(struct error *err);
@@ -0,0 +1,111 @@
+#include "error.h"
+#include "ast.h"
+#include "command_funcs.h"
+#include "resolver.h"
+#include "arithmetic.h"
+#include "fold.h"
+
+static void fold_node(struct ast_node *node, struct error **err);
+
+void fold_constants(struct ast_node *ast, struct resolution *res)
+{
+	for (size_t i = 0; i < res->statement_count; ++i) {
+		struct error *err = NULL;
+		fold_statement(ast->args[i], &err);
+		if (err != NULL) {
+			// Fails before the error the resolver found, if any
+			error_free(res->err);
+			res->err = err;
+			res->statement_count = i;
+			return;
+		}
+	}
+}
+
+static bool numeric_value(const struct ast_node *node, struct value *val)
+{
+	switch (node->tok.type) {
+	case TOKEN_INT:
+		*val = value_int(node->tok.int_val);
+		return true;
+	case TOKEN_DOUBLE:
+		*val = value_double(node->tok.double_val);
+		return true;
+	case TOKEN_CONSTANT:
+		*val = node->result;
+		return true;
+	default:
+		return false;
+	}
+}
+
+// Operands are folded before the subcommand that uses them
+void fold_statement(struct ast_node *node, struct error **err)
+{
+	struct ast_walk walk;
+	ast_walk_init(&walk, node);
+
+	struct ast_node *curr;
+	while (*err == NULL && (curr = ast_walk_next(&walk)) != NULL) {
+		fold_node(curr, err);
+	}
+
+	ast_walk_free(&walk);
+}
+
+static void fold_node(struct ast_node *node, struct error **err)
+{
+	if (node->tok.type != TOKEN_SUBCOMMAND || node->argc != 2) {
+		return;
+	}
+
+	struct value x, y;
+	if (!numeric_value(node->args[0], &x) ||
+	    !numeric_value(node->args[1], &y)) {
+		return;
+	}
+
+	struct value result;
+	if (arith_is_int(x, y)) {
+		int a = value_as_int(x);
+		int b = value_as_int(y);
+		if (node->func == subcommand_func_add) {
+			result = value_int(arith_int_add(a, b));
+		} else if (node->func == subcommand_func_sub) {
+			result = value_int(arith_int_sub(a, b));
+		} else if (node->func == subcommand_func_mul) {
+			result = value_int(arith_int_mul(a, b));
+		} else if (node->func == subcommand_func_div) {
+			if (b == 0) {
+				*err = error_create(ERROR_INTERPRETER,
+						    ERROR_RUNTIME_ERROR,
+						    node->pos.line,
+						    node->pos.column,
+						    "Division by zero");
+				return;
+			}
+			result = value_int(arith_int_div(a, b));
+		} else {
+			return;
+		}
+	} else {
+		double a = arith_to_double(x);
+		double b = arith_to_double(y);
+		if (node->func == subcommand_func_add) {
+			result = value_double(a + b);
+		} else if (node->func == subcommand_func_sub) {
+			result = value_double(a - b);
+		} else if (node->func == subcommand_func_mul) {
+			result = value_double(a * b);
+		} else if (node->func == subcommand_func_div) {
+			result = value_double(a / b);
+		} else {
+			return;
+		}
+	}
+
+	node->tok.type = TOKEN_CONSTANT;
+	node->result = result;
+	node->func = NULL;
+	node->argc = 0;
+}
@@ -0,0 +1,19 @@
+#ifndef FOLD_H
+#define FOLD_H
+
+struct ast_node;
+struct resolution;
+struct error;
+
+/*
+ * Replaces ADD, SUB, MUL and DIV subcommands whose operands are all numeric
+ * literals with a TOKEN_CONSTANT node holding the result. An integer
+ * division by zero found here becomes the error of the resolution, raised
+ * when its statement is reached.
+ */
+void fold_constants(struct ast_node *ast, struct resolution *res);
+
+// Folds a single resolved statement, err is set on a division by zero
+void fold_statement(struct ast_node *statement, struct error **err);
+
+#endif
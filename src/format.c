@@ -0,0 +1,410 @@
+#include "format.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+static const char digit_pairs[200] =
+	"0001020304050607080910111213141516171819"
+	"2021222324252627282930313233343536373839"
+	"4041424344454647484950515253545556575859"
+	"6061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+size_t format_int(char *buf, int x)
+{
+	char digits[FORMAT_INT_MAX];
+	char *end = digits + sizeof(digits);
+	char *p = end;
+
+	// Negated as unsigned so INT_MIN works too
+	uint32_t value = x < 0 ? 0u - (uint32_t)x : (uint32_t)x;
+	while (value >= 100) {
+		p -= 2;
+		memcpy(p, &digit_pairs[value % 100 * 2], 2);
+		value /= 100;
+	}
+	if (value >= 10) {
+		p -= 2;
+		memcpy(p, &digit_pairs[value * 2], 2);
+	} else {
+		*--p = '0' + value;
+	}
+	if (x < 0) {
+		*--p = '-';
+	}
+
+	size_t length = end - p;
+	memcpy(buf, p, length);
+	return length;
+}
+
+size_t format_double_fixed(char *buf, double x)
+{
+	return snprintf(buf, FORMAT_DOUBLE_FIXED_MAX, "%f", x);
+}
+
+// Floating point number with a 64 bit significand, f * 2^e
+struct diy_fp {
+	uint64_t f;
+	int e;
+};
+
+#define SIGNIFICAND_BITS 52
+#define HIDDEN_BIT (1ull << SIGNIFICAND_BITS)
+#define EXPONENT_BIAS (0x3FF + SIGNIFICAND_BITS)
+
+// Normalized 10^k for k = -348, -340, ..., 340
+static const struct diy_fp cached_powers[] = {
+	{ 0xfa8fd5a0081c0288ull, -1220 }, // 1e-348
+	{ 0xbaaee17fa23ebf76ull, -1193 }, // 1e-340
+	{ 0x8b16fb203055ac76ull, -1166 }, // 1e-332
+	{ 0xcf42894a5dce35eaull, -1140 }, // 1e-324
+	{ 0x9a6bb0aa55653b2dull, -1113 }, // 1e-316
+	{ 0xe61acf033d1a45dfull, -1087 }, // 1e-308
+	{ 0xab70fe17c79ac6caull, -1060 }, // 1e-300
+	{ 0xff77b1fcbebcdc4full, -1034 }, // 1e-292
+	{ 0xbe5691ef416bd60cull, -1007 }, // 1e-284
+	{ 0x8dd01fad907ffc3cull, -980 }, // 1e-276
+	{ 0xd3515c2831559a83ull, -954 }, // 1e-268
+	{ 0x9d71ac8fada6c9b5ull, -927 }, // 1e-260
+	{ 0xea9c227723ee8bcbull, -901 }, // 1e-252
+	{ 0xaecc49914078536dull, -874 }, // 1e-244
+	{ 0x823c12795db6ce57ull, -847 }, // 1e-236
+	{ 0xc21094364dfb5637ull, -821 }, // 1e-228
+	{ 0x9096ea6f3848984full, -794 }, // 1e-220
+	{ 0xd77485cb25823ac7ull, -768 }, // 1e-212
+	{ 0xa086cfcd97bf97f4ull, -741 }, // 1e-204
+	{ 0xef340a98172aace5ull, -715 }, // 1e-196
+	{ 0xb23867fb2a35b28eull, -688 }, // 1e-188
+	{ 0x84c8d4dfd2c63f3bull, -661 }, // 1e-180
+	{ 0xc5dd44271ad3cdbaull, -635 }, // 1e-172
+	{ 0x936b9fcebb25c996ull, -608 }, // 1e-164
+	{ 0xdbac6c247d62a584ull, -582 }, // 1e-156
+	{ 0xa3ab66580d5fdaf6ull, -555 }, // 1e-148
+	{ 0xf3e2f893dec3f126ull, -529 }, // 1e-140
+	{ 0xb5b5ada8aaff80b8ull, -502 }, // 1e-132
+	{ 0x87625f056c7c4a8bull, -475 }, // 1e-124
+	{ 0xc9bcff6034c13053ull, -449 }, // 1e-116
+	{ 0x964e858c91ba2655ull, -422 }, // 1e-108
+	{ 0xdff9772470297ebdull, -396 }, // 1e-100
+	{ 0xa6dfbd9fb8e5b88full, -369 }, // 1e-92
+	{ 0xf8a95fcf88747d94ull, -343 }, // 1e-84
+	{ 0xb94470938fa89bcfull, -316 }, // 1e-76
+	{ 0x8a08f0f8bf0f156bull, -289 }, // 1e-68
+	{ 0xcdb02555653131b6ull, -263 }, // 1e-60
+	{ 0x993fe2c6d07b7facull, -236 }, // 1e-52
+	{ 0xe45c10c42a2b3b06ull, -210 }, // 1e-44
+	{ 0xaa242499697392d3ull, -183 }, // 1e-36
+	{ 0xfd87b5f28300ca0eull, -157 }, // 1e-28
+	{ 0xbce5086492111aebull, -130 }, // 1e-20
+	{ 0x8cbccc096f5088ccull, -103 }, // 1e-12
+	{ 0xd1b71758e219652cull, -77 }, // 1e-4
+	{ 0x9c40000000000000ull, -50 }, // 1e4
+	{ 0xe8d4a51000000000ull, -24 }, // 1e12
+	{ 0xad78ebc5ac620000ull, 3 }, // 1e20
+	{ 0x813f3978f8940984ull, 30 }, // 1e28
+	{ 0xc097ce7bc90715b3ull, 56 }, // 1e36
+	{ 0x8f7e32ce7bea5c70ull, 83 }, // 1e44
+	{ 0xd5d238a4abe98068ull, 109 }, // 1e52
+	{ 0x9f4f2726179a2245ull, 136 }, // 1e60
+	{ 0xed63a231d4c4fb27ull, 162 }, // 1e68
+	{ 0xb0de65388cc8ada8ull, 189 }, // 1e76
+	{ 0x83c7088e1aab65dbull, 216 }, // 1e84
+	{ 0xc45d1df942711d9aull, 242 }, // 1e92
+	{ 0x924d692ca61be758ull, 269 }, // 1e100
+	{ 0xda01ee641a708deaull, 295 }, // 1e108
+	{ 0xa26da3999aef774aull, 322 }, // 1e116
+	{ 0xf209787bb47d6b85ull, 348 }, // 1e124
+	{ 0xb454e4a179dd1877ull, 375 }, // 1e132
+	{ 0x865b86925b9bc5c2ull, 402 }, // 1e140
+	{ 0xc83553c5c8965d3dull, 428 }, // 1e148
+	{ 0x952ab45cfa97a0b3ull, 455 }, // 1e156
+	{ 0xde469fbd99a05fe3ull, 481 }, // 1e164
+	{ 0xa59bc234db398c25ull, 508 }, // 1e172
+	{ 0xf6c69a72a3989f5cull, 534 }, // 1e180
+	{ 0xb7dcbf5354e9beceull, 561 }, // 1e188
+	{ 0x88fcf317f22241e2ull, 588 }, // 1e196
+	{ 0xcc20ce9bd35c78a5ull, 614 }, // 1e204
+	{ 0x98165af37b2153dfull, 641 }, // 1e212
+	{ 0xe2a0b5dc971f303aull, 667 }, // 1e220
+	{ 0xa8d9d1535ce3b396ull, 694 }, // 1e228
+	{ 0xfb9b7cd9a4a7443cull, 720 }, // 1e236
+	{ 0xbb764c4ca7a44410ull, 747 }, // 1e244
+	{ 0x8bab8eefb6409c1aull, 774 }, // 1e252
+	{ 0xd01fef10a657842cull, 800 }, // 1e260
+	{ 0x9b10a4e5e9913129ull, 827 }, // 1e268
+	{ 0xe7109bfba19c0c9dull, 853 }, // 1e276
+	{ 0xac2820d9623bf429ull, 880 }, // 1e284
+	{ 0x80444b5e7aa7cf85ull, 907 }, // 1e292
+	{ 0xbf21e44003acdd2dull, 933 }, // 1e300
+	{ 0x8e679c2f5e44ff8full, 960 }, // 1e308
+	{ 0xd433179d9c8cb841ull, 986 }, // 1e316
+	{ 0x9e19db92b4e31ba9ull, 1013 }, // 1e324
+	{ 0xeb96bf6ebadf77d9ull, 1039 }, // 1e332
+	{ 0xaf87023b9bf0ee6bull, 1066 }, // 1e340
+};
+
+#define CACHED_POWERS_MIN_EXP10 -348
+#define CACHED_POWERS_STEP 8
+
+static const uint64_t powers_of_ten[] = {
+	1ull,
+	10ull,
+	100ull,
+	1000ull,
+	10000ull,
+	100000ull,
+	1000000ull,
+	10000000ull,
+	100000000ull,
+	1000000000ull,
+	10000000000ull,
+	100000000000ull,
+	1000000000000ull,
+	10000000000000ull,
+	100000000000000ull,
+	1000000000000000ull,
+	10000000000000000ull,
+	100000000000000000ull,
+	1000000000000000000ull,
+	10000000000000000000ull,
+};
+
+static struct diy_fp diy_fp_from_double(uint64_t bits)
+{
+	uint64_t significand = bits & (HIDDEN_BIT - 1);
+	int biased_exp = (bits >> SIGNIFICAND_BITS) & 0x7FF;
+
+	if (biased_exp == 0) {
+		// Denormal
+		return (struct diy_fp){ significand, 1 - EXPONENT_BIAS };
+	}
+	return (struct diy_fp){ significand + HIDDEN_BIT,
+				biased_exp - EXPONENT_BIAS };
+}
+
+static struct diy_fp diy_fp_normalize(struct diy_fp x)
+{
+	int shift = __builtin_clzll(x.f);
+	return (struct diy_fp){ x.f << shift, x.e - shift };
+}
+
+// Product rounded to the upper 64 bits
+static struct diy_fp diy_fp_mul(struct diy_fp a, struct diy_fp b)
+{
+	unsigned __int128 p = (unsigned __int128)a.f * b.f;
+	uint64_t high = p >> 64;
+	if ((uint64_t)p & (1ull << 63)) {
+		++high;
+	}
+	return (struct diy_fp){ high, a.e + b.e + 64 };
+}
+
+// Neighbours halfway to the next and previous double, with the same exponent
+static void normalized_boundaries(struct diy_fp v, struct diy_fp *minus,
+				  struct diy_fp *plus)
+{
+	*plus = diy_fp_normalize((struct diy_fp){ (v.f << 1) + 1, v.e - 1 });
+
+	// The gap below a power of two is half as wide as the one above it
+	if (v.f == HIDDEN_BIT) {
+		*minus = (struct diy_fp){ (v.f << 2) - 1, v.e - 2 };
+	} else {
+		*minus = (struct diy_fp){ (v.f << 1) - 1, v.e - 1 };
+	}
+	minus->f <<= minus->e - plus->e;
+	minus->e = plus->e;
+}
+
+// Power of ten that scales a number with binary exponent e to [-60, -32]
+static struct diy_fp cached_power(int e, int *k)
+{
+	double dk = (-61 - e) * 0.30102999566398114 + 347;
+	int ik = (int)dk;
+	if (dk - ik > 0.0) {
+		++ik;
+	}
+
+	size_t index = (ik >> 3) + 1;
+	*k = -(CACHED_POWERS_MIN_EXP10 + (int)index * CACHED_POWERS_STEP);
+	return cached_powers[index];
+}
+
+static int count_digits(uint32_t n)
+{
+	int count = 1;
+	while (count < 10 && n >= powers_of_ten[count]) {
+		++count;
+	}
+	return count;
+}
+
+// Moves the last digit towards w while it stays inside the boundaries
+static void grisu_round(char *digits, int length, uint64_t delta,
+			uint64_t rest, uint64_t ten_kappa, uint64_t wp_w)
+{
+	while (rest < wp_w && delta - rest >= ten_kappa &&
+	       (rest + ten_kappa < wp_w ||
+		wp_w - rest > rest + ten_kappa - wp_w)) {
+		--digits[length - 1];
+		rest += ten_kappa;
+	}
+}
+
+// Generates digits of mp until they are inside [mp - delta, mp]
+static int digit_gen(struct diy_fp w, struct diy_fp mp, uint64_t delta,
+		     char *digits, int *k)
+{
+	struct diy_fp one = { 1ull << -mp.e, mp.e };
+	uint64_t wp_w = mp.f - w.f;
+	uint32_t p1 = mp.f >> -one.e;
+	uint64_t p2 = mp.f & (one.f - 1);
+	int kappa = count_digits(p1);
+	int length = 0;
+
+	while (kappa > 0) {
+		uint32_t d = p1 / powers_of_ten[kappa - 1];
+		p1 %= powers_of_ten[kappa - 1];
+		if (d != 0 || length != 0) {
+			digits[length++] = '0' + d;
+		}
+		--kappa;
+
+		uint64_t rest = ((uint64_t)p1 << -one.e) + p2;
+		if (rest <= delta) {
+			*k += kappa;
+			grisu_round(digits, length, delta, rest,
+				    powers_of_ten[kappa] << -one.e, wp_w);
+			return length;
+		}
+	}
+
+	for (;;) {
+		p2 *= 10;
+		delta *= 10;
+		char d = p2 >> -one.e;
+		if (d != 0 || length != 0) {
+			digits[length++] = '0' + d;
+		}
+		p2 &= one.f - 1;
+		--kappa;
+
+		if (p2 < delta) {
+			*k += kappa;
+			int index = -kappa;
+			grisu_round(digits, length, delta, p2, one.f,
+				    wp_w * (index < 20 ? powers_of_ten[index] :
+							 0));
+			return length;
+		}
+	}
+}
+
+// Digits of a finite, positive x, x is digits * 10^k
+static int grisu2(double x, char *digits, int *k)
+{
+	uint64_t bits;
+	memcpy(&bits, &x, sizeof(bits));
+
+	struct diy_fp v = diy_fp_from_double(bits);
+	struct diy_fp minus, plus;
+	normalized_boundaries(v, &minus, &plus);
+
+	struct diy_fp c_mk = cached_power(plus.e, k);
+	struct diy_fp w = diy_fp_mul(diy_fp_normalize(v), c_mk);
+	struct diy_fp wp = diy_fp_mul(plus, c_mk);
+	struct diy_fp wm = diy_fp_mul(minus, c_mk);
+
+	// Stay clear of the boundaries, the products are off by at most one
+	++wm.f;
+	--wp.f;
+	return digit_gen(w, wp, wp.f - wm.f, digits, k);
+}
+
+static size_t write_exponent(char *buf, int exp)
+{
+	char *p = buf;
+	*p++ = 'e';
+	if (exp < 0) {
+		*p++ = '-';
+		exp = -exp;
+	} else {
+		*p++ = '+';
+	}
+
+	if (exp >= 100) {
+		*p++ = '0' + exp / 100;
+		exp %= 100;
+	}
+	memcpy(p, &digit_pairs[exp * 2], 2);
+	return p + 2 - buf;
+}
+
+// Lays out length digits with the decimal point after point digits
+static size_t prettify(char *buf, const char *digits, int length, int point)
+{
+	char *p = buf;
+
+	if (point > 16 || point < -3) {
+		*p++ = digits[0];
+		if (length > 1) {
+			*p++ = '.';
+			memcpy(p, digits + 1, length - 1);
+			p += length - 1;
+		}
+		return p - buf + write_exponent(p, point - 1);
+	}
+
+	if (point <= 0) {
+		memcpy(p, "0.", 2);
+		p += 2;
+		memset(p, '0', -point);
+		p += -point;
+		memcpy(p, digits, length);
+		return p + length - buf;
+	}
+
+	if (point >= length) {
+		memcpy(p, digits, length);
+		p += length;
+		memset(p, '0', point - length);
+		p += point - length;
+		memcpy(p, ".0", 2);
+		return p + 2 - buf;
+	}
+
+	memcpy(p, digits, point);
+	p += point;
+	*p++ = '.';
+	memcpy(p, digits + point, length - point);
+	return p + length - point - buf;
+}
+
+size_t format_double_shortest(char *buf, double x)
+{
+	if (isnan(x)) {
+		memcpy(buf, "nan", 3);
+		return 3;
+	}
+
+	char *p = buf;
+	if (signbit(x)) {
+		*p++ = '-';
+		x = -x;
+	}
+
+	if (isinf(x)) {
+		memcpy(p, "inf", 3);
+		return p + 3 - buf;
+	}
+	if (x == 0.0) {
+		memcpy(p, "0.0", 3);
+		return p + 3 - buf;
+	}
+
+	char digits[20];
+	int k = 0;
+	int length = grisu2(x, digits, &k);
+	return p - buf + prettify(p, digits, length, length + k);
+}
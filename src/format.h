@@ -0,0 +1,40 @@
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include <stdlib.h>
+#include <float.h>
+
+/*
+ * Number to text conversion for PRINT. Every function writes into a buffer
+ * owned by the caller and returns the number of bytes written, nothing is
+ * NUL terminated.
+ */
+
+// Longest output of format_int, "-2147483648"
+#define FORMAT_INT_MAX 11
+// Longest output of format_double_shortest, "-2.2250738585072014e-308"
+#define FORMAT_DOUBLE_SHORTEST_MAX 32
+/*
+ * Longest output of format_double_fixed and the NUL snprintf writes after
+ * it, -DBL_MAX has a sign, 309 integer digits and ".000000"
+ */
+#define FORMAT_DOUBLE_FIXED_MAX (DBL_MAX_10_EXP + 10)
+
+enum FORMAT_DOUBLE_STYLE {
+	FORMAT_DOUBLE_FIXED, // Six decimals like %f, the default
+	FORMAT_DOUBLE_SHORTEST, // Fewest digits that read back as the same value
+};
+
+size_t format_int(char *buf, int x);
+
+size_t format_double_fixed(char *buf, double x);
+
+/*
+ * Grisu2, the digits always read back as x and are the shortest possible
+ * for nearly every double. Magnitudes from 1e-4 up to 1e16 are written in
+ * positional notation with at least one decimal ("1.5", "100.0"), the rest
+ * in scientific notation ("1e+16", "2.5e-07").
+ */
+size_t format_double_shortest(char *buf, double x);
+
+#endif
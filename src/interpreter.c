@@ -1,61 +1,113 @@
 #include "error.h"
 #include "ast.h"
 #include "interpreter.h"
-#include "symbol_table.h"
+#include "resolver.h"
 #include "command.h"
+#include "string_heap.h"
+#include <assert.h>
 
-static enum EXT_CODE eval_subcommands(struct ast_node *command_node,
-				      struct command_base *cb,
-				      struct symbol_table *symbol_table)
+#define INITIAL_PROGRAM_SIZE 64
+
+/*
+ * Every command and subcommand of the statements that run, in the order
+ * they execute: a statement comes right after its operands. Running the
+ * program is then a single pass over one array.
+ */
+static struct ast_node **flatten(const struct ast_node *const ast,
+				 size_t statement_count, size_t *length)
 {
-	for (int i = command_node->argc - 1; i >= 0; --i) {
-		if (command_node->args[i]->tok.type == TOKEN_SUBCOMMAND) {
-			enum EXT_CODE result = eval_subcommands(
-				command_node->args[i], cb, symbol_table);
-			if (result != EXT_SUCCESS) {
-				return result;
+	size_t capacity = INITIAL_PROGRAM_SIZE;
+	struct ast_node **program = malloc(sizeof(*program) * capacity);
+	assert(program != NULL);
+	*length = 0;
+
+	for (size_t i = 0; i < statement_count; ++i) {
+		struct ast_walk walk;
+		ast_walk_init(&walk, ast->args[i]);
+
+		struct ast_node *node;
+		while ((node = ast_walk_next(&walk)) != NULL) {
+			// Folded subcommands and plain operands do not execute
+			if (node->func == NULL) {
+				continue;
 			}
 
-			struct error *err = NULL;
-			command_exec(cb, command_node->args[i], symbol_table,
-				     &err);
-			if (err != NULL) {
-				error_print(err);
-				return EXT_FAIL;
+			if (*length == capacity) {
+				capacity *= 2;
+				program = realloc(program,
+						  sizeof(*program) * capacity);
+				assert(program != NULL);
 			}
+			program[(*length)++] = node;
 		}
+
+		ast_walk_free(&walk);
 	}
-	return EXT_SUCCESS;
+
+	return program;
 }
 
 enum EXT_CODE interpret_ast(const struct ast_node *const ast,
-			    struct command_base *cb)
+			    const struct resolution *res)
 {
-	struct scope_table *global_scope = scope_table_create(NULL, 2);
-	struct symbol_table *symbol_table = symbol_table_create(global_scope);
+	struct frame frame = {
+		.slots = calloc(res->slot_count + 1,
+				sizeof(struct value)),
+		.slot_count = res->slot_count,
+	};
+	assert(frame.slots != NULL);
 	enum EXT_CODE result = EXT_SUCCESS;
 
-	for (size_t i = 0; i < ast->argc; ++i) {
-		struct ast_node *current_command = ast->args[i];
-		if (current_command->tok.type == TOKEN_EOF) {
+	size_t length;
+	struct ast_node **program = flatten(ast, res->statement_count, &length);
+
+	for (size_t i = 0; i < length; ++i) {
+		struct error *err = NULL;
+		command_exec(program[i], &frame, &err);
+		if (err != NULL) {
+			error_print(err);
+			error_free(err);
+			result = EXT_FAIL;
 			break;
 		}
-		struct error *err = NULL;
+	}
 
-		result = eval_subcommands(current_command, cb, symbol_table);
-		if (result != EXT_SUCCESS) {
-			symbol_table_free(symbol_table);
-			return result;
+	if (result == EXT_SUCCESS && res->err != NULL) {
+		error_print(res->err);
+		result = EXT_FAIL;
+	}
+
+	free(program);
+	for (size_t i = 0; i < frame.slot_count; ++i) {
+		value_release(frame.slots[i]);
+	}
+	free(frame.slots);
+	return result;
+}
+
+enum EXT_CODE interpret_statement(struct ast_node *statement,
+				  struct frame *frame)
+{
+	struct ast_walk walk;
+	ast_walk_init(&walk, statement);
+	enum EXT_CODE result = EXT_SUCCESS;
+
+	struct ast_node *node;
+	while ((node = ast_walk_next(&walk)) != NULL) {
+		if (node->func == NULL) {
+			continue;
 		}
 
-		command_exec(cb, current_command, symbol_table, &err);
+		struct error *err = NULL;
+		command_exec(node, frame, &err);
 		if (err != NULL) {
 			error_print(err);
-			symbol_table_free(symbol_table);
-			return EXT_FAIL;
+			error_free(err);
+			result = EXT_FAIL;
+			break;
 		}
 	}
 
-	symbol_table_free(symbol_table);
-	return EXT_SUCCESS;
+	ast_walk_free(&walk);
+	return result;
 }
@@ -2,11 +2,16 @@
 #define INTERPRETER_H
 
 struct ast_node;
-struct command_base;
+struct resolution;
+struct frame;
 
 enum EXT_CODE { EXT_SUCCESS, EXT_FAIL };
 
 enum EXT_CODE interpret_ast(const struct ast_node *const ast,
-			    struct command_base *cb);
+			    const struct resolution *res);
+
+// Runs one resolved and folded statement, errors are printed
+enum EXT_CODE interpret_statement(struct ast_node *statement,
+				  struct frame *frame);
 
 #endif
@@ -0,0 +1,547 @@
+#include "error.h"
+#include "bytecode.h"
+#include "jit.h"
+#include "vm.h"
+#include "output.h"
+#include "string_heap.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#if defined(__x86_64__) && defined(__unix__)
+
+#include <sys/mman.h>
+
+#define INITIAL_CODE_SIZE 4096
+
+/*
+ * The generated function is
+ *	uint32_t run(struct value *slots, struct value *stack)
+ * and keeps the value stack pointer in rbx, slots in r12 and the tag of
+ * ints in r13, all of them callee saved so they survive calls into C. It
+ * returns the index of the instruction it stopped at shifted left by
+ * JIT_EXIT_SHIFT, with the reason in the low bits.
+ */
+enum JIT_EXIT {
+	JIT_EXIT_HALT,
+	JIT_EXIT_FAIL, // OP_FAIL, chunk->err is raised
+	JIT_EXIT_CALL, // OP_CALL printed its error already
+	JIT_EXIT_STRING_ARITHMETIC,
+	JIT_EXIT_DIVISION_BY_ZERO,
+	JIT_EXIT_ASSIGN,
+};
+
+#define JIT_EXIT_SHIFT 3
+#define JIT_EXIT_MASK ((1u << JIT_EXIT_SHIFT) - 1)
+
+typedef uint32_t (*jit_func)(struct value *slots, struct value *stack);
+
+struct jit {
+	uint8_t *code;
+	size_t length;
+	size_t allocated;
+	size_t exit; // Offset of the epilogue every exit jumps to
+};
+
+enum CONDITION {
+	CC_E = 0x4,
+	CC_NE = 0x5,
+	CC_NP = 0xB,
+};
+
+static void emit_bytes(struct jit *j, const void *bytes, size_t len)
+{
+	if (j->length + len > j->allocated) {
+		while (j->length + len > j->allocated) {
+			j->allocated *= 2;
+		}
+		j->code = realloc(j->code, j->allocated);
+		assert(j->code != NULL);
+	}
+	memcpy(j->code + j->length, bytes, len);
+	j->length += len;
+}
+
+#define EMIT(j, ...)                                          \
+	do {                                                  \
+		const uint8_t bytes[] = { __VA_ARGS__ };      \
+		emit_bytes((j), bytes, sizeof(bytes));        \
+	} while (0)
+
+static void emit_u32(struct jit *j, uint32_t x)
+{
+	emit_bytes(j, &x, sizeof(x));
+}
+
+static void emit_u64(struct jit *j, uint64_t x)
+{
+	emit_bytes(j, &x, sizeof(x));
+}
+
+// Returns the offset of the rel32 to patch once the target is known
+static size_t emit_jcc(struct jit *j, enum CONDITION cc)
+{
+	EMIT(j, 0x0F, 0x80 | cc);
+	emit_u32(j, 0);
+	return j->length - 4;
+}
+
+static size_t emit_jmp(struct jit *j)
+{
+	EMIT(j, 0xE9);
+	emit_u32(j, 0);
+	return j->length - 4;
+}
+
+// Points the jump at the next instruction
+static void bind(struct jit *j, size_t rel)
+{
+	int32_t offset = (int32_t)(j->length - (rel + 4));
+	memcpy(j->code + rel, &offset, sizeof(offset));
+}
+
+static void emit_exit(struct jit *j, size_t index, enum JIT_EXIT reason)
+{
+	assert(index < (UINT32_MAX >> JIT_EXIT_SHIFT));
+	EMIT(j, 0xB8); // mov eax, imm32
+	emit_u32(j, (uint32_t)index << JIT_EXIT_SHIFT | reason);
+
+	// The epilogue is emitted first, so this jumps backwards
+	EMIT(j, 0xE9); // jmp rel32
+	int64_t offset = (int64_t)j->exit - (int64_t)(j->length + 4);
+	emit_u32(j, (uint32_t)(int32_t)offset);
+}
+
+static void emit_call(struct jit *j, const void *func)
+{
+	EMIT(j, 0x48, 0xB8); // mov rax, imm64
+	emit_u64(j, (uint64_t)(uintptr_t)func);
+	EMIT(j, 0xFF, 0xD0); // call rax
+}
+
+// Offset of a slot from r12, as a disp32
+static uint32_t slot_offset(uint32_t slot)
+{
+	assert(slot < (UINT32_MAX >> 4));
+	return slot * sizeof(struct value);
+}
+
+// Sets the condition flags to compare the tag of rax with tag
+static void emit_tag_cmp(struct jit *j, uint32_t src, uint32_t tag)
+{
+	if (src == 0) {
+		EMIT(j, 0x48, 0x89, 0xC2); // mov rdx, rax
+	} else {
+		EMIT(j, 0x48, 0x89, 0xCA); // mov rdx, rcx
+	}
+	EMIT(j, 0x48, 0xC1, 0xEA, VALUE_TAG_SHIFT); // shr rdx, 48
+	EMIT(j, 0x81, 0xFA); // cmp edx, imm32
+	emit_u32(j, tag);
+}
+
+/*
+ * Loads rax (src 0) or rcx (src 1) into xmm0 or xmm1 as a double, ints are
+ * converted. A string jumps to the returned rel32.
+ */
+static size_t emit_to_double(struct jit *j, uint32_t src)
+{
+	emit_tag_cmp(j, src, VALUE_TAG_INT);
+	size_t not_int = emit_jcc(j, CC_NE);
+	if (src == 0) {
+		EMIT(j, 0xF2, 0x0F, 0x2A, 0xC0); // cvtsi2sd xmm0, eax
+	} else {
+		EMIT(j, 0xF2, 0x0F, 0x2A, 0xC9); // cvtsi2sd xmm1, ecx
+	}
+	size_t converted = emit_jmp(j);
+
+	bind(j, not_int);
+	EMIT(j, 0x81, 0xFA); // cmp edx, imm32
+	emit_u32(j, VALUE_TAG_STR);
+	size_t string = emit_jcc(j, CC_E);
+	if (src == 0) {
+		EMIT(j, 0x66, 0x48, 0x0F, 0x6E, 0xC0); // movq xmm0, rax
+	} else {
+		EMIT(j, 0x66, 0x48, 0x0F, 0x6E, 0xC9); // movq xmm1, rcx
+	}
+
+	bind(j, converted);
+	return string;
+}
+
+// Generic, int and double forms of an operation share their instructions
+static enum OPCODE generic_op(enum OPCODE op)
+{
+	if (op >= OP_ADD_DOUBLE) {
+		return op - OP_ADD_DOUBLE + OP_ADD;
+	}
+	if (op >= OP_ADD_INT) {
+		return op - OP_ADD_INT + OP_ADD;
+	}
+	return op;
+}
+
+/*
+ * eax op ecx into rax as an int value. 32 bit instructions wrap like
+ * arith_int_* and clear the upper half. A division by zero jumps to the
+ * returned rel32, other operations return 0.
+ */
+static size_t emit_int_op(struct jit *j, enum OPCODE op)
+{
+	size_t division_by_zero = 0;
+	switch (generic_op(op)) {
+	case OP_ADD:
+		EMIT(j, 0x01, 0xC8); // add eax, ecx
+		break;
+	case OP_SUB:
+		EMIT(j, 0x29, 0xC8); // sub eax, ecx
+		break;
+	case OP_MUL:
+		EMIT(j, 0x0F, 0xAF, 0xC1); // imul eax, ecx
+		break;
+	default: {
+		EMIT(j, 0x85, 0xC9); // test ecx, ecx
+		division_by_zero = emit_jcc(j, CC_E);
+		EMIT(j, 0x83, 0xF9, 0xFF); // cmp ecx, -1
+		size_t divide = emit_jcc(j, CC_NE);
+		EMIT(j, 0xF7, 0xD8); // neg eax
+		size_t negated = emit_jmp(j);
+		bind(j, divide);
+		EMIT(j, 0x99); // cdq
+		EMIT(j, 0xF7, 0xF9); // idiv ecx
+		bind(j, negated);
+		break;
+	}
+	}
+	EMIT(j, 0x4C, 0x09, 0xE8); // or rax, r13
+	return division_by_zero;
+}
+
+// xmm0 op xmm1 into rax as a double value
+static void emit_double_op(struct jit *j, enum OPCODE op)
+{
+	switch (generic_op(op)) {
+	case OP_ADD:
+		EMIT(j, 0xF2, 0x0F, 0x58, 0xC1); // addsd xmm0, xmm1
+		break;
+	case OP_SUB:
+		EMIT(j, 0xF2, 0x0F, 0x5C, 0xC1); // subsd xmm0, xmm1
+		break;
+	case OP_MUL:
+		EMIT(j, 0xF2, 0x0F, 0x59, 0xC1); // mulsd xmm0, xmm1
+		break;
+	default:
+		EMIT(j, 0xF2, 0x0F, 0x5E, 0xC1); // divsd xmm0, xmm1
+		break;
+	}
+	EMIT(j, 0x66, 0x48, 0x0F, 0x7E, 0xC0); // movq rax, xmm0
+
+	// NaNs keep only their sign, like value_double
+	EMIT(j, 0x66, 0x0F, 0x2E, 0xC0); // ucomisd xmm0, xmm0
+	size_t not_nan = emit_jcc(j, CC_NP);
+	EMIT(j, 0x48, 0xBA); // mov rdx, imm64
+	emit_u64(j, VALUE_SIGN_BIT);
+	EMIT(j, 0x48, 0x21, 0xD0); // and rax, rdx
+	EMIT(j, 0x48, 0xBA); // mov rdx, imm64
+	emit_u64(j, VALUE_QUIET_NAN);
+	EMIT(j, 0x48, 0x09, 0xD0); // or rax, rdx
+	bind(j, not_nan);
+}
+
+// Replaces the two operands with rax
+static void emit_store_result(struct jit *j)
+{
+	EMIT(j, 0x48, 0x89, 0x43, 0xF0); // mov [rbx - 16], rax
+	EMIT(j, 0x48, 0x83, 0xEB, 0x08); // sub rbx, 8
+}
+
+static void emit_arithmetic(struct jit *j, enum OPCODE op, size_t index)
+{
+	EMIT(j, 0x48, 0x8B, 0x43, 0xF0); // mov rax, [rbx - 16]
+	EMIT(j, 0x48, 0x8B, 0x4B, 0xF8); // mov rcx, [rbx - 8]
+
+	// Both are ints only if the int tag survives an AND of the two
+	EMIT(j, 0x48, 0x89, 0xC2); // mov rdx, rax
+	EMIT(j, 0x48, 0x21, 0xCA); // and rdx, rcx
+	EMIT(j, 0x48, 0xC1, 0xEA, VALUE_TAG_SHIFT); // shr rdx, 48
+	EMIT(j, 0x81, 0xFA); // cmp edx, imm32
+	emit_u32(j, VALUE_TAG_INT);
+	size_t not_int = emit_jcc(j, CC_NE);
+
+	size_t division_by_zero = emit_int_op(j, op);
+	size_t store = emit_jmp(j);
+
+	bind(j, not_int);
+	size_t x_string = emit_to_double(j, 0);
+	size_t y_string = emit_to_double(j, 1);
+	emit_double_op(j, op);
+
+	bind(j, store);
+	emit_store_result(j);
+	size_t done = emit_jmp(j);
+
+	bind(j, x_string);
+	bind(j, y_string);
+	emit_exit(j, index, JIT_EXIT_STRING_ARITHMETIC);
+	if (op == OP_DIV) {
+		bind(j, division_by_zero);
+		emit_exit(j, index, JIT_EXIT_DIVISION_BY_ZERO);
+	}
+
+	bind(j, done);
+}
+
+// The compiler proved both operands are ints
+static void emit_int_arithmetic(struct jit *j, enum OPCODE op, size_t index)
+{
+	EMIT(j, 0x8B, 0x43, 0xF0); // mov eax, [rbx - 16]
+	EMIT(j, 0x8B, 0x4B, 0xF8); // mov ecx, [rbx - 8]
+	size_t division_by_zero = emit_int_op(j, op);
+	emit_store_result(j);
+	if (op == OP_DIV_INT) {
+		size_t done = emit_jmp(j);
+		bind(j, division_by_zero);
+		emit_exit(j, index, JIT_EXIT_DIVISION_BY_ZERO);
+		bind(j, done);
+	}
+}
+
+// The compiler proved both operands are doubles
+static void emit_double_arithmetic(struct jit *j, enum OPCODE op)
+{
+	EMIT(j, 0xF3, 0x0F, 0x7E, 0x43, 0xF0); // movq xmm0, [rbx - 16]
+	EMIT(j, 0xF3, 0x0F, 0x7E, 0x4B, 0xF8); // movq xmm1, [rbx - 8]
+	emit_double_op(j, op);
+	emit_store_result(j);
+}
+
+static void print_value(struct value val)
+{
+	output_value(val);
+	output_char('\n');
+}
+
+static void emit_instruction(struct jit *j, const struct chunk *chunk,
+			     size_t index)
+{
+	const struct instruction *ins = &chunk->code[index];
+	switch (ins->op) {
+	case OP_CONST:
+		EMIT(j, 0x48, 0xB8); // mov rax, imm64
+		emit_u64(j, chunk->constants[ins->arg].bits);
+		EMIT(j, 0x48, 0x89, 0x03); // mov [rbx], rax
+		EMIT(j, 0x48, 0x83, 0xC3, 0x08); // add rbx, 8
+		break;
+	case OP_LOAD:
+		EMIT(j, 0x49, 0x8B, 0x84, 0x24); // mov rax, [r12 + disp32]
+		emit_u32(j, slot_offset(ins->arg));
+		EMIT(j, 0x48, 0x89, 0x03); // mov [rbx], rax
+		EMIT(j, 0x48, 0x83, 0xC3, 0x08); // add rbx, 8
+		break;
+	case OP_CREATE: {
+		EMIT(j, 0x48, 0x8B, 0x43, 0xF8); // mov rax, [rbx - 8]
+		EMIT(j, 0x48, 0x83, 0xEB, 0x08); // sub rbx, 8
+		EMIT(j, 0x49, 0x89, 0x84, 0x24); // mov [r12 + disp32], rax
+		emit_u32(j, slot_offset(ins->arg));
+
+		// The slot takes a reference to strings
+		emit_tag_cmp(j, 0, VALUE_TAG_STR);
+		size_t not_string = emit_jcc(j, CC_NE);
+		EMIT(j, 0x48, 0x89, 0xC7); // mov rdi, rax
+		emit_call(j, value_retain);
+		bind(j, not_string);
+		break;
+	}
+	case OP_SET:
+		EMIT(j, 0x49, 0x8D, 0xBC, 0x24); // lea rdi, [r12 + disp32]
+		emit_u32(j, slot_offset(ins->arg));
+		EMIT(j, 0x48, 0x8B, 0x73, 0xF8); // mov rsi, [rbx - 8]
+		EMIT(j, 0x48, 0x83, 0xEB, 0x08); // sub rbx, 8
+		emit_call(j, vm_assign);
+		EMIT(j, 0x84, 0xC0); // test al, al
+		size_t assigned = emit_jcc(j, CC_NE);
+		emit_exit(j, index, JIT_EXIT_ASSIGN);
+		bind(j, assigned);
+		break;
+	case OP_PRINT:
+		EMIT(j, 0x48, 0x8B, 0x7B, 0xF8); // mov rdi, [rbx - 8]
+		EMIT(j, 0x48, 0x83, 0xEB, 0x08); // sub rbx, 8
+		emit_call(j, print_value);
+		break;
+	case OP_ADD:
+	case OP_SUB:
+	case OP_MUL:
+	case OP_DIV:
+		emit_arithmetic(j, ins->op, index);
+		break;
+	case OP_ADD_INT:
+	case OP_SUB_INT:
+	case OP_MUL_INT:
+	case OP_DIV_INT:
+		emit_int_arithmetic(j, ins->op, index);
+		break;
+	case OP_ADD_DOUBLE:
+	case OP_SUB_DOUBLE:
+	case OP_MUL_DOUBLE:
+	case OP_DIV_DOUBLE:
+		emit_double_arithmetic(j, ins->op);
+		break;
+	case OP_TO_DOUBLE:
+		// Never a NaN, so no canonical form to make
+		EMIT(j, 0xF2, 0x0F, 0x2A, 0x43, 0xF8); // cvtsi2sd xmm0, [rbx - 8]
+		EMIT(j, 0x66, 0x0F, 0xD6, 0x43, 0xF8); // movq [rbx - 8], xmm0
+		break;
+	case OP_TO_INT:
+		// Truncates like arith_to_int, NaN and out of range give INT_MIN
+		EMIT(j, 0xF2, 0x0F, 0x2C, 0x43, 0xF8); // cvttsd2si eax, [rbx - 8]
+		EMIT(j, 0x4C, 0x09, 0xE8); // or rax, r13
+		EMIT(j, 0x48, 0x89, 0x43, 0xF8); // mov [rbx - 8], rax
+		break;
+	case OP_STORE:
+		EMIT(j, 0x48, 0x8B, 0x43, 0xF8); // mov rax, [rbx - 8]
+		EMIT(j, 0x48, 0x83, 0xEB, 0x08); // sub rbx, 8
+		EMIT(j, 0x49, 0x89, 0x84, 0x24); // mov [r12 + disp32], rax
+		emit_u32(j, slot_offset(ins->arg));
+		break;
+	case OP_CALL: {
+		EMIT(j, 0x48, 0xBF); // mov rdi, imm64
+		emit_u64(j, (uint64_t)(uintptr_t)chunk);
+		EMIT(j, 0x4C, 0x89, 0xE6); // mov rsi, r12
+		EMIT(j, 0xBA); // mov edx, imm32
+		emit_u32(j, ins->arg);
+		emit_call(j, vm_call);
+		EMIT(j, 0x84, 0xC0); // test al, al
+		size_t called = emit_jcc(j, CC_NE);
+		emit_exit(j, index, JIT_EXIT_CALL);
+		bind(j, called);
+		break;
+	}
+	case OP_FAIL:
+		emit_exit(j, index, JIT_EXIT_FAIL);
+		break;
+	case OP_HALT:
+		emit_exit(j, index, JIT_EXIT_HALT);
+		break;
+	}
+}
+
+// Returns the offset of the entry point, the epilogue comes first
+static size_t translate(struct jit *j, const struct chunk *chunk)
+{
+	j->exit = j->length;
+	EMIT(j, 0x48, 0x83, 0xC4, 0x08); // add rsp, 8
+	EMIT(j, 0x41, 0x5D); // pop r13
+	EMIT(j, 0x41, 0x5C); // pop r12
+	EMIT(j, 0x5B); // pop rbx
+	EMIT(j, 0x5D); // pop rbp
+	EMIT(j, 0xC3); // ret
+
+	// Four pushes and 8 bytes keep rsp 16 byte aligned at every call
+	size_t entry = j->length;
+	EMIT(j, 0x55); // push rbp
+	EMIT(j, 0x53); // push rbx
+	EMIT(j, 0x41, 0x54); // push r12
+	EMIT(j, 0x41, 0x55); // push r13
+	EMIT(j, 0x48, 0x83, 0xEC, 0x08); // sub rsp, 8
+	EMIT(j, 0x49, 0x89, 0xFC); // mov r12, rdi
+	EMIT(j, 0x48, 0x89, 0xF3); // mov rbx, rsi
+	EMIT(j, 0x49, 0xBD); // mov r13, imm64
+	emit_u64(j, VALUE_TAG_INT << VALUE_TAG_SHIFT);
+
+	for (size_t i = 0; i < chunk->code_length; ++i) {
+		emit_instruction(j, chunk, i);
+	}
+	return entry;
+}
+
+static void raise_exit(const struct chunk *chunk, uint32_t exit)
+{
+	size_t index = exit >> JIT_EXIT_SHIFT;
+	struct source_pos pos = chunk->positions[index];
+	const char *message;
+
+	switch (exit & JIT_EXIT_MASK) {
+	case JIT_EXIT_FAIL:
+		error_print(chunk->err);
+		return;
+	case JIT_EXIT_CALL:
+		return;
+	case JIT_EXIT_STRING_ARITHMETIC:
+		message = "Can not do arithmetic on a string";
+		break;
+	case JIT_EXIT_DIVISION_BY_ZERO:
+		message = "Division by zero";
+		break;
+	default:
+		message = "Can not assign a value of a different type to a variable";
+		break;
+	}
+
+	struct error *err = error_create(ERROR_INTERPRETER,
+					 ERROR_RUNTIME_ERROR, pos.line,
+					 pos.column, "%s", message);
+	error_print(err);
+	error_free(err);
+}
+
+enum EXT_CODE jit_run(const struct chunk *const chunk)
+{
+	struct jit j = {
+		.code = malloc(INITIAL_CODE_SIZE),
+		.length = 0,
+		.allocated = INITIAL_CODE_SIZE,
+		.exit = 0,
+	};
+	assert(j.code != NULL);
+	size_t entry = translate(&j, chunk);
+
+	// Written while writable, then only executable
+	void *mem = mmap(NULL, j.length, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED) {
+		free(j.code);
+		return vm_run(chunk);
+	}
+	memcpy(mem, j.code, j.length);
+	free(j.code);
+	if (mprotect(mem, j.length, PROT_READ | PROT_EXEC) != 0) {
+		munmap(mem, j.length);
+		return vm_run(chunk);
+	}
+
+	struct value *slots =
+		calloc(chunk->slot_count + 1, sizeof(struct value));
+	assert(slots != NULL);
+	struct value *stack =
+		malloc((chunk->max_stack + 1) * sizeof(struct value));
+	assert(stack != NULL);
+
+	jit_func run;
+	void *entry_point = (uint8_t *)mem + entry;
+	memcpy(&run, &entry_point, sizeof(run));
+	uint32_t exit = run(slots, stack);
+
+	enum EXT_CODE result = EXT_SUCCESS;
+	if ((exit & JIT_EXIT_MASK) != JIT_EXIT_HALT) {
+		raise_exit(chunk, exit);
+		result = EXT_FAIL;
+	}
+
+	munmap(mem, j.length);
+	free(stack);
+	for (size_t i = 0; i < chunk->slot_count; ++i) {
+		value_release(slots[i]);
+	}
+	free(slots);
+	return result;
+}
+
+#else
+
+enum EXT_CODE jit_run(const struct chunk *const chunk)
+{
+	return vm_run(chunk);
+}
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "interpreter.h"
+
+struct chunk;
+
+/*
+ * Translates the bytecode of a chunk to x86-64 machine code and runs it.
+ * Arithmetic is done inline with the same promotion rules as the VM, OP_SET,
+ * OP_PRINT and OP_CALL call the functions the VM uses, so the output is the
+ * same byte for byte. Other targets, or a failure to map executable memory,
+ * run the chunk with vm_run instead.
+ */
+enum EXT_CODE jit_run(const struct chunk *const chunk);
+
+#endif
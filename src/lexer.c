@@ -1,38 +1,45 @@
 #include "error.h"
 #include "lexer.h"
 #include "command.h"
+#include "scan.h"
+#include "number.h"
 
 #include <string.h>
 #include <stdlib.h>
 #include <ctype.h>
 #include <assert.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 static struct token create_command_or_identifier_token(struct lexer *lexer);
 static struct token create_number(struct lexer *lexer, struct error **err);
 static struct token create_str(struct lexer *lexer, struct error **err);
 static void skip_comment(struct lexer *lexer);
 
-struct lexer *lexer_create(const char *source, struct command_base *cb)
+struct lexer *lexer_create(const char *source, size_t length,
+			   struct command_base *cb)
 {
 	struct lexer *lexer = malloc(sizeof(*lexer));
 	assert(lexer != NULL);
 
-	lexer->source = strdup(source);
-	if (!lexer->source) {
-		free(lexer);
-		return NULL;
-	}
-
-	lexer->pos = 0;
-	lexer->line = 1;
-	lexer->column = 1;
-	lexer->current_char = lexer->source[0];
 	lexer->cb = cb;
+	lexer_rebase(lexer, source, length, 1, 1);
 
 	return lexer;
 }
 
+void lexer_rebase(struct lexer *lexer, const char *source, size_t length,
+		  size_t line, size_t column)
+{
+	lexer->source = source;
+	lexer->length = length;
+	lexer->pos = 0;
+	lexer->line = line;
+	lexer->column = column;
+	lexer->start_column = column;
+	lexer->current_char = length > 0 ? source[0] : '\0';
+}
+
 static void lexer_advance(struct lexer *lexer)
 {
 	if (lexer->current_char == '\n') {
@@ -43,18 +50,46 @@ static void lexer_advance(struct lexer *lexer)
 	}
 
 	++lexer->pos;
-	if (lexer->pos >= strlen(lexer->source)) {
+	if (lexer->pos >= lexer->length) {
 		lexer->current_char = '\0';
 	} else {
 		lexer->current_char = lexer->source[lexer->pos];
 	}
 }
 
-static void skip_comment(struct lexer *lexer)
+// Moves to pos as if lexer_advance was called for every byte before it
+static void lexer_jump(struct lexer *lexer, size_t pos)
 {
-	while (lexer->current_char != '\n' && lexer->current_char != '\0') {
-		lexer_advance(lexer);
+	const char *from = lexer->source + lexer->pos;
+	size_t n = pos - lexer->pos;
+
+	size_t newlines = scan_count(from, n, '\n');
+	if (newlines == 0) {
+		lexer->column += n;
+	} else {
+		const char *last_newline = lexer->source + pos - 1;
+		while (*last_newline != '\n') {
+			--last_newline;
+		}
+		lexer->line += newlines;
+		lexer->column = lexer->source + pos - last_newline;
 	}
+
+	lexer->pos = pos;
+	lexer->current_char = pos < lexer->length ? lexer->source[pos] : '\0';
+}
+
+static void skip_comment(struct lexer *lexer)
+{
+	size_t n = scan_find2(lexer->source + lexer->pos,
+			      lexer->length - lexer->pos, '\n', '\0');
+
+	// No newline before the end of the comment, only the column moves
+	lexer->pos += n;
+	lexer->column += n;
+	lexer->current_char = lexer->pos < lexer->length ?
+				      lexer->source[lexer->pos] :
+				      '\0';
 	lexer_advance(lexer); // To move past the newline character
 }
 
@@ -77,15 +112,47 @@ struct token lexer_next_token(struct lexer *lexer, struct error **err)
 			return create_command_or_identifier_token(lexer);
 		}
 		if (isspace(lexer->current_char)) {
-			lexer_advance(lexer);
+			lexer_jump(lexer,
+				   lexer->pos + scan_skip_space(
+							lexer->source + lexer->pos,
+							lexer->length - lexer->pos));
 			continue;
 		}
 		lexer_advance(lexer);
 	}
 
-	return (struct token){ .type = TOKEN_EOF,
-			       .value = NULL,
-			       .max_argc = 0 };
+	return (struct token){ .type = TOKEN_EOF, .offset = lexer->pos };
+}
+
+struct source_pos lexer_locate(const struct lexer *lexer, struct token tok)
+{
+	if (tok.type == TOKEN_EOF || tok.type == TOKEN_START) {
+		return (struct source_pos){ 0, 0 };
+	}
+
+	// Only strings can span lines
+	size_t newlines = 0;
+	if (tok.type == TOKEN_STR) {
+		newlines = scan_count(lexer->source + tok.offset,
+				      lexer->pos - tok.offset, '\n');
+	}
+	if (newlines == 0) {
+		return (struct source_pos){
+			lexer->line, lexer->column - (lexer->pos - tok.offset)
+		};
+	}
+
+	size_t line_start = tok.offset;
+	while (line_start > 0 && lexer->source[line_start - 1] != '\n') {
+		--line_start;
+	}
+
+	// The line may have started before the buffer did
+	size_t column = tok.offset - line_start + 1;
+	if (line_start == 0) {
+		column += lexer->start_column - 1;
+	}
+	return (struct source_pos){ lexer->line - newlines, column };
 }
 
 static struct token create_command_or_identifier_token(struct lexer *lexer)
@@ -96,138 +163,95 @@ static struct token create_command_or_identifier_token(struct lexer *lexer)
 		lexer_advance(lexer);
 	}
 
-	size_t len = lexer->pos - start_pos;
+	struct token tok = { .type = TOKEN_IDENTIFIER,
+			     .offset = start_pos,
+			     .length = lexer->pos - start_pos };
 
-	char *value = malloc(len + 1);
-	assert(value != NULL);
-
-	strncpy(value, lexer->source + start_pos, len);
-	value[len] = '\0';
-
-	if (command_exists(lexer->cb, value)) {
-		struct command c = command_get(lexer->cb, value);
-		return (struct token){ .type = TOKEN_COMMAND,
-				       .value = value,
-				       .line = lexer->line,
-				       .column = lexer->column - len,
-				       .max_argc = c.max_argc };
-	} else if (subcommand_exists(lexer->cb, value)) {
-		struct command c = subcommand_get(lexer->cb, value);
-		return (struct token){ .type = TOKEN_SUBCOMMAND,
-				       .value = value,
-				       .line = lexer->line,
-				       .column = lexer->column - len,
-				       .max_argc = c.max_argc };
-	} else {
-		return (struct token){ .type = TOKEN_IDENTIFIER,
-				       .value = value,
-				       .line = lexer->line,
-				       .column = lexer->column - len,
-				       .max_argc = 0 };
+	bool subcommand;
+	tok.command = command_lookup(lexer->cb, lexer->source + start_pos,
+				     tok.length, &subcommand);
+	if (tok.command != NULL) {
+		tok.type = subcommand ? TOKEN_SUBCOMMAND : TOKEN_COMMAND;
+	}
+	return tok;
+}
+
+// Literals are converted here once, running a program never reads digits
+static struct token parse_number(const char *text, size_t len, bool is_double)
+{
+	if (is_double) {
+		return (struct token){ .type = TOKEN_DOUBLE,
+				       .double_val =
+					       number_parse_double(text, len) };
 	}
+
+	struct token tok = { .type = TOKEN_INT };
+	tok.int_overflow = !number_parse_int(text, len, &tok.int_val);
+	return tok;
 }
 
 static struct token create_number(struct lexer *lexer, struct error **err)
 {
 	size_t start_pos = lexer->pos;
-	bool start_with_dot = lexer->source[start_pos] == '.';
-	bool is_double = start_with_dot;
+	bool is_double = lexer->current_char == '.';
 	lexer_advance(lexer);
 
-	while (isdigit(lexer->source[lexer->pos]) ||
-	       lexer->source[lexer->pos] == '.') {
-		if (lexer->source[lexer->pos] == '.') {
+	while (isdigit(lexer->current_char) || lexer->current_char == '.') {
+		if (lexer->current_char == '.') {
 			is_double = true;
 		}
 		lexer_advance(lexer);
 	}
-	if (isalpha(lexer->source[lexer->pos])) {
+	if (isalpha(lexer->current_char)) {
 		*err = error_create(ERROR_LEXER, ERROR_INVALID_IDENTIFIER,
 				    lexer->line, lexer->column,
 				    "Invalid identifier starting with a digit");
 
 		return (struct token){ .type = TOKEN_INVALID_IDENTIFIER,
-				       .value = "",
-				       .line = lexer->line,
-				       .column = lexer->column,
-				       .max_argc = 0 };
+				       .offset = lexer->pos };
 	}
 
+	// A leading dot reads as 0. so there is nothing to add
 	size_t len = lexer->pos - start_pos;
-	if (start_with_dot)
-		len = lexer->pos - start_pos + 1; // +1 for the 0 at start
-
-	char *value = malloc(len + 1);
-	assert(value != NULL);
-
-	if (start_with_dot)
-		strncpy(value + 1, lexer->source + start_pos,
-			len); // +1 so it skips the first character which will be 0
-	else
-		strncpy(value, lexer->source + start_pos, len);
-	value[len] = '\0';
-
-	if (start_with_dot)
-		value[0] = '0';
-
-	enum TOKEN_TYPE tok_type;
-	if (is_double)
-		tok_type = TOKEN_DOUBLE;
-	else
-		tok_type = TOKEN_INT;
-
-	return (struct token){ .type = tok_type,
-			       .value = value,
-			       .line = lexer->line,
-			       .column = lexer->column - len,
-			       .max_argc = 0 };
+	struct token tok =
+		parse_number(lexer->source + start_pos, len, is_double);
+	tok.offset = start_pos;
+	tok.length = len;
+	return tok;
 }
 
 static struct token create_str(struct lexer *lexer, struct error **err)
 {
 	lexer_advance(lexer); //Skip the literal symbol "|"
 	size_t start_pos = lexer->pos;
-	while (lexer->source[lexer->pos] != '|') {
-		if (lexer->source[lexer->pos] == '\0') {
-			*err = error_create(
-				ERROR_LEXER, ERROR_UNEXPECTED_EOF, lexer->line,
-				lexer->column,
-				"Unexpected end of file while scanning string literal");
-			return (struct token){ .type = TOKEN_EOF,
-					       .value = NULL,
-					       .max_argc = 0 };
-		}
-		lexer_advance(lexer);
+	lexer_jump(lexer, start_pos + scan_find2(lexer->source + start_pos,
+						 lexer->length - start_pos,
+						 '|', '\0'));
+	if (lexer->current_char != '|') {
+		*err = error_create(
+			ERROR_LEXER, ERROR_UNEXPECTED_EOF, lexer->line,
+			lexer->column,
+			"Unexpected end of file while scanning string literal");
+		return (struct token){ .type = TOKEN_EOF,
+				       .offset = lexer->pos };
 	}
 
 	size_t len = lexer->pos - start_pos;
-
-	char *value = malloc(len + 1);
-	assert(value != NULL);
-
-	strncpy(value, lexer->source + start_pos, len);
-	value[len] = '\0';
+	if (len > UINT32_MAX) {
+		*err = error_create(ERROR_LEXER, ERROR_SYNTAX_ERROR,
+				    lexer->line, lexer->column,
+				    "String literal is too long");
+		return (struct token){ .type = TOKEN_EOF,
+				       .offset = lexer->pos };
+	}
 
 	lexer_advance(lexer); //Skip the ending literal symbol
 	return (struct token){ .type = TOKEN_STR,
-			       .value = value,
-			       .line = lexer->line,
-			       .column = lexer->column - len,
-			       .max_argc = 0 };
+			       .offset = start_pos,
+			       .length = len };
 }
 
 void lexer_destroy(struct lexer *lexer)
 {
-	if (lexer) {
-		free((char *)lexer->source);
-		free(lexer);
-	}
-}
-
-void token_destroy(struct token *token)
-{
-	if (token && token->value) {
-		free(token->value);
-		token->value = NULL;
-	}
+	free(lexer);
 }
@@ -2,7 +2,11 @@
 #define LEXER_H
 
 #include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "source.h"
 
+struct command;
 struct command_base;
 struct error;
 
@@ -16,30 +20,50 @@ enum TOKEN_TYPE {
 	TOKEN_STR,
 	TOKEN_INVALID_IDENTIFIER,
 	TOKEN_EOF,
+	TOKEN_CONSTANT, // Folded subcommand, never made by the lexer
 };
 
+/*
+ * Tokens point into the source instead of owning a copy of their text, the
+ * line and column are derived from the offset only when they are needed.
+ */
 struct token {
 	enum TOKEN_TYPE type;
-	size_t line;
-	size_t column;
-	size_t max_argc;
-	char *value;
+	uint32_t length; // Length of the text, without the | of strings
+	size_t offset; // Offset of the text in the source
+	union {
+		struct {
+			int int_val; // TOKEN_INT
+			bool int_overflow; // Does not fit in an int
+		};
+		double double_val; // TOKEN_DOUBLE
+		const struct command *command; // Commands and subcommands
+	};
 };
 
 struct lexer {
-	const char *source;
+	const char *source; // Not owned and not NUL terminated
+	size_t length;
 	size_t pos;
 	size_t line;
 	size_t column;
+	size_t start_column; // Column of source[0]
 	char current_char;
 
 	struct command_base *cb;
 };
 
-struct lexer *lexer_create(const char *source, struct command_base *cb);
+struct lexer *lexer_create(const char *source, size_t length,
+			   struct command_base *cb);
 struct token lexer_next_token(struct lexer *lexer, struct error **err);
 
+// Continues on a new buffer, its first byte is at line and column
+void lexer_rebase(struct lexer *lexer, const char *source, size_t length,
+		  size_t line, size_t column);
+
+// Only valid for the token lexer_next_token returned last
+struct source_pos lexer_locate(const struct lexer *lexer, struct token tok);
+
 void lexer_destroy(struct lexer *lexer);
-void token_destroy(struct token *token);
 
 #endif
@@ -1,76 +1,161 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "ast.h"
 #include "parser.h"
 #include "interpreter.h"
 #include "command.h"
 #include "command_funcs.h"
+#include "bytecode.h"
+#include "compiler.h"
+#include "vm.h"
+#include "jit.h"
+#include "closure.h"
+#include "emit_c.h"
+#include "cache.h"
+#include "resolver.h"
+#include "fold.h"
+#include "types.h"
+#include "stream.h"
+#include "output.h"
+#include "error.h"
+#include "source.h"
+#include "arena.h"
 #include <assert.h>
 
-char *read_file_to_str(const char *filename)
-{
-	FILE *file = fopen(filename, "r");
-	assert(file != NULL);
-
-	fseek(file, 0, SEEK_END);
-	long len = ftell(file);
-	fseek(file, 0, SEEK_SET);
-
-	char *buf = malloc(len + 1);
-	assert(buf != NULL);
-
-	fread(buf, 1, len, file);
-	buf[len] = '\0';
-
-	fclose(file);
-
-	return buf;
-}
-
 void ext_fail()
 {
+	output_flush();
 	fprintf(stderr, "%s\n",
 		"ERROR Interpreting: Failed to interpret the code exit code: 1");
 	exit(EXT_FAIL);
 }
 
+void usage(const char *program)
+{
+	fprintf(stderr,
+		"Usage: %s [--ast | --closure | --jit | --emit-c] [--stream] [--shortest] <filename | ->\n",
+		program);
+	fprintf(stderr, "    --ast       Walk the AST instead of running bytecode\n");
+	fprintf(stderr, "    --closure   Run the AST compiled to a tree of closures\n");
+	fprintf(stderr, "    --jit       Compile to machine code before running\n");
+	fprintf(stderr, "    --emit-c    Write the program as C instead of running it\n");
+	fprintf(stderr, "    --stream    Run each statement as soon as it is read\n");
+	fprintf(stderr, "    --shortest  Print doubles with the fewest digits that "
+			"read back exactly\n");
+	ext_fail();
+}
+
 int main(int argc, const char *argv[])
 {
-	if (argc < 2) {
-		fprintf(stderr, "Usage: %s <filename>\n", argv[0]);
-		ext_fail();
+	const char *filename = NULL;
+	bool walk_ast = false;
+	bool closures = false;
+	bool jit = false;
+	bool emit = false;
+	bool shortest = false;
+	bool stream = false;
+
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--ast") == 0) {
+			walk_ast = true;
+		} else if (strcmp(argv[i], "--closure") == 0) {
+			closures = true;
+		} else if (strcmp(argv[i], "--jit") == 0) {
+			jit = true;
+		} else if (strcmp(argv[i], "--emit-c") == 0) {
+			emit = true;
+		} else if (strcmp(argv[i], "--stream") == 0) {
+			stream = true;
+		} else if (strcmp(argv[i], "--shortest") == 0) {
+			output_set_double_style(FORMAT_DOUBLE_SHORTEST);
+			shortest = true;
+		} else if (strncmp(argv[i], "--", 2) == 0 || filename != NULL) {
+			usage(argv[0]);
+		} else {
+			filename = argv[i];
+		}
+	}
+	// Emitted programs print doubles with printf and read no input
+	if (filename == NULL || (emit && (stream || shortest))) {
+		usage(argv[0]);
 	}
-
-	const char *filename = argv[1];
-	char *file_content = read_file_to_str(filename);
 
 	struct command_base *cb = command_base_create();
 	command_register(cb, "PRINT", command_func_print, 1);
 	command_register(cb, "CREATE", command_func_create, 2);
 	command_register(cb, "SET", command_func_set, 2);
 
-	subcommand_register(cb, "ADD", subcommand_func_arithmetic, 2);
-	subcommand_register(cb, "SUB", subcommand_func_arithmetic, 2);
-	subcommand_register(cb, "MUL", subcommand_func_arithmetic, 2);
-	subcommand_register(cb, "DIV", subcommand_func_arithmetic, 2);
+	subcommand_register(cb, "ADD", subcommand_func_add, 2);
+	subcommand_register(cb, "SUB", subcommand_func_sub, 2);
+	subcommand_register(cb, "MUL", subcommand_func_mul, 2);
+	subcommand_register(cb, "DIV", subcommand_func_div, 2);
+
+	if (stream) {
+		if (stream_run(filename, cb) == EXT_FAIL) {
+			ext_fail();
+		}
+		return EXT_SUCCESS;
+	}
+
+	struct source *source = source_open(filename);
+	if (source == NULL) {
+		fprintf(stderr, "Could not read file '%s'\n", filename);
+		ext_fail();
+	}
+
+	// Unchanged programs run the bytecode they were compiled to last time
+	struct chunk *chunk = NULL;
+	if (!walk_ast && !closures && !emit) {
+		chunk = cache_load(filename, source);
+	}
+	if (chunk != NULL) {
+		enum EXT_CODE result = jit ? jit_run(chunk) : vm_run(chunk);
+		chunk_free(chunk);
+		source_close(source);
+		if (result == EXT_FAIL) {
+			ext_fail();
+		}
+		return EXT_SUCCESS;
+	}
 
-	struct lexer *lexer = lexer_create(file_content, cb);
+	struct arena *arena = arena_create();
+	struct lexer *lexer = lexer_create(source->data, source->length, cb);
 
-	struct ast_node *ast = parse_tokens(lexer);
+	struct ast_node *ast = parse_tokens(lexer, arena);
 	if (ast == NULL) {
 		ext_fail();
 	}
 
-	if (interpret_ast(ast, cb) == EXT_FAIL) {
+	struct resolution res = resolve_ast(ast);
+	fold_constants(ast, &res);
+	infer_types(ast, &res);
+
+	enum EXT_CODE result;
+	if (emit) {
+		result = emit_c(ast, &res, filename);
+	} else if (walk_ast) {
+		result = interpret_ast(ast, &res);
+	} else if (closures) {
+		result = closure_run(ast, &res);
+	} else {
+		chunk = compile_ast(ast, &res);
+		cache_store(filename, source, chunk);
+		result = jit ? jit_run(chunk) : vm_run(chunk);
+		chunk_free(chunk);
+	}
+	error_free(res.err);
+
+	if (result == EXT_FAIL) {
 		lexer_destroy(lexer);
-		ast_free(ast);
-		free(file_content);
+		arena_destroy(arena);
+		source_close(source);
 
 		ext_fail();
 	}
 
 	lexer_destroy(lexer);
-	ast_free(ast);
-	free(file_content);
+	arena_destroy(arena);
+	source_close(source);
 	return EXT_SUCCESS;
 }
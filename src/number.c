@@ -0,0 +1,291 @@
+#include "number.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <limits.h>
+
+// A uint64_t holds any 19 digit number
+#define MAX_MANTISSA_DIGITS 19
+// Doubles hold integers up to 2^53 and powers of ten up to 1e22 exactly
+#define MAX_EXACT_MANTISSA (1ull << 53)
+#define MAX_EXACT_POW10 22
+
+// Numbers are short, they are copied so strtod can not read past the source
+#define NUMBER_BUFFER_SIZE 128
+
+static const double exact_pow10[] = {
+	1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+	1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+	1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+static bool is_digit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+
+static uint64_t load_eight(const char *p)
+{
+	uint64_t chunk;
+	memcpy(&chunk, p, sizeof(chunk));
+	return chunk;
+}
+
+static bool is_eight_digits(const char *p)
+{
+	uint64_t chunk = load_eight(p);
+	return ((chunk & 0xF0F0F0F0F0F0F0F0) |
+		(((chunk + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4)) ==
+	       0x3333333333333333;
+}
+
+// Value of eight ASCII digits, combined in pairs, quads and then halves
+static uint32_t parse_eight_digits(const char *p)
+{
+	uint64_t chunk = load_eight(p) - 0x3030303030303030;
+	chunk = (chunk * 10) + (chunk >> 8);
+	chunk = (((chunk & 0x000000FF000000FF) * (100 + (1000000ull << 32))) +
+		 (((chunk >> 16) & 0x000000FF000000FF) *
+		  (1 + (10000ull << 32)))) >>
+		32;
+	return chunk;
+}
+
+#else
+
+static bool is_eight_digits(const char *p)
+{
+	for (size_t i = 0; i < 8; ++i) {
+		if (!is_digit(p[i])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static uint32_t parse_eight_digits(const char *p)
+{
+	uint32_t value = 0;
+	for (size_t i = 0; i < 8; ++i) {
+		value = value * 10 + (p[i] - '0');
+	}
+	return value;
+}
+
+#endif
+
+bool number_parse_int(const char *text, size_t len, int *out)
+{
+	const char *p = text;
+	const char *end = text + len;
+
+	bool negative = p < end && *p == '-';
+	if (negative) {
+		++p;
+	}
+	while (p < end && *p == '0') {
+		++p;
+	}
+
+	// More than ten digits never fit, this also keeps value from wrapping
+	if (end - p > 10) {
+		return false;
+	}
+
+	uint64_t value = 0;
+	if (end - p >= 8) {
+		value = parse_eight_digits(p);
+		p += 8;
+	}
+	for (; p < end; ++p) {
+		value = value * 10 + (*p - '0');
+	}
+
+	uint64_t limit = negative ? (uint64_t)INT_MAX + 1 : INT_MAX;
+	if (value > limit) {
+		return false;
+	}
+
+	*out = negative ? (int)(0u - (uint32_t)value) : (int)value;
+	return true;
+}
+
+static double strtod_fallback(const char *text, size_t len)
+{
+	char buffer[NUMBER_BUFFER_SIZE];
+	char *str = len < sizeof(buffer) ? buffer : malloc(len + 1);
+	assert(str != NULL);
+	memcpy(str, text, len);
+	str[len] = '\0';
+
+	double value = strtod(str, NULL);
+
+	if (str != buffer) {
+		free(str);
+	}
+	return value;
+}
+
+static double make_double(uint64_t bits)
+{
+	double value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+/*
+ * Eisel-Lemire, w * 10^q rounded to the nearest double. Fails when the
+ * product of w and the truncated power of ten is too close to a halfway
+ * point to round, or the result is subnormal or does not fit.
+ */
+static bool eisel_lemire(uint64_t w, int q, bool negative, double *out)
+{
+	uint64_t sign = (uint64_t)negative << 63;
+	if (w == 0) {
+		*out = make_double(sign);
+		return true;
+	}
+	if (q < NUMBER_POW10_MIN_EXP || q > NUMBER_POW10_MAX_EXP) {
+		return false;
+	}
+
+	const uint64_t *pow10 = number_pow10_table[q - NUMBER_POW10_MIN_EXP];
+	int lz = __builtin_clzll(w);
+	w <<= lz;
+
+	// floor(log2(10^q)) + 64 + bias, 217706 / 2^16 is log2(10)
+	int64_t exp2 = (((int64_t)217706 * q) >> 16) + 64 + 1023 - lz;
+
+	unsigned __int128 product = (unsigned __int128)w * pow10[0];
+	uint64_t high = product >> 64;
+	uint64_t low = product;
+
+	// The low bits are not enough to decide, add the second half of 10^q
+	if ((high & 0x1FF) == 0x1FF && low + w < low) {
+		unsigned __int128 rest = (unsigned __int128)w * pow10[1];
+		uint64_t rest_high = rest >> 64;
+		uint64_t rest_low = rest;
+
+		uint64_t merged_high = high;
+		uint64_t merged_low = low + rest_high;
+		if (merged_low < low) {
+			++merged_high;
+		}
+		if ((merged_high & 0x1FF) == 0x1FF && merged_low + 1 == 0 &&
+		    rest_low + w < rest_low) {
+			return false;
+		}
+		high = merged_high;
+		low = merged_low;
+	}
+
+	uint64_t msb = high >> 63;
+	uint64_t mantissa = high >> (msb + 9);
+	exp2 -= (int64_t)(1 ^ msb);
+
+	// Exactly halfway between two doubles, the round to even is ambiguous
+	if (low == 0 && (high & 0x1FF) == 0 && (mantissa & 3) == 1) {
+		return false;
+	}
+
+	mantissa += mantissa & 1;
+	mantissa >>= 1;
+	if (mantissa >> 53 != 0) {
+		mantissa >>= 1;
+		++exp2;
+	}
+
+	// Subnormals, infinities and zeros are left to strtod
+	if (exp2 <= 0 || exp2 >= 0x7FF) {
+		return false;
+	}
+
+	*out = make_double(sign | (uint64_t)exp2 << 52 |
+			   (mantissa & ((1ull << 52) - 1)));
+	return true;
+}
+
+double number_parse_double(const char *text, size_t len)
+{
+	const char *p = text;
+	const char *end = text + len;
+
+	bool negative = p < end && *p == '-';
+	if (negative) {
+		++p;
+	}
+
+	uint64_t w = 0; // First MAX_MANTISSA_DIGITS significant digits
+	int q = 0; // Power of ten w is scaled by
+	size_t significant = 0;
+	bool truncated = false; // A nonzero digit did not fit in w
+	bool any_digit = false;
+
+	for (int part = 0; part < 2; ++part) {
+		bool fraction = part == 1;
+		if (fraction) {
+			if (p >= end || *p != '.') {
+				break;
+			}
+			++p;
+		}
+
+		// Leading zeros only move the point
+		for (; significant == 0 && p < end && *p == '0'; ++p) {
+			any_digit = true;
+			q -= fraction;
+		}
+
+		while (end - p >= 8 &&
+		       significant + 8 <= MAX_MANTISSA_DIGITS &&
+		       is_eight_digits(p)) {
+			w = w * 100000000 + parse_eight_digits(p);
+			significant += 8;
+			q -= fraction ? 8 : 0;
+			p += 8;
+			any_digit = true;
+		}
+
+		for (; p < end && is_digit(*p); ++p) {
+			any_digit = true;
+			if (significant < MAX_MANTISSA_DIGITS) {
+				w = w * 10 + (*p - '0');
+				++significant;
+				q -= fraction;
+			} else {
+				truncated |= *p != '0';
+				q += !fraction;
+			}
+		}
+	}
+
+	// strtod gives a positive zero when there is nothing to convert
+	if (!any_digit) {
+		return 0.0;
+	}
+
+	// Clinger's fast path, both operands are exact so the division rounds once
+	if (!truncated && w <= MAX_EXACT_MANTISSA && q <= 0 &&
+	    q >= -MAX_EXACT_POW10) {
+		double value = (double)w / exact_pow10[-q];
+		return negative ? -value : value;
+	}
+
+	double value;
+	if (eisel_lemire(w, q, negative, &value)) {
+		if (!truncated) {
+			return value;
+		}
+
+		// The dropped digits are somewhere between w and w + 1
+		double upper;
+		if (eisel_lemire(w + 1, q, negative, &upper) &&
+		    value == upper) {
+			return value;
+		}
+	}
+
+	return strtod_fallback(text, len);
+}
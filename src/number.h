@@ -0,0 +1,28 @@
+#ifndef NUMBER_H
+#define NUMBER_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Conversion of numeric literals, done once by the lexer. text is what the
+ * lexer scanned for a number: an optional '-' followed by digits and dots,
+ * it does not need to be NUL terminated.
+ */
+
+// False if the literal does not fit in an int, out is left untouched then
+bool number_parse_int(const char *text, size_t len, int *out);
+
+/*
+ * Reads like strtod, anything after a second dot is ignored. Correctly
+ * rounded, Eisel-Lemire handles almost every literal and strtod the rest.
+ */
+double number_parse_double(const char *text, size_t len);
+
+#define NUMBER_POW10_MIN_EXP -348
+#define NUMBER_POW10_MAX_EXP 347
+
+extern const uint64_t number_pow10_table[][2];
+
+#endif
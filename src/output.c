@@ -0,0 +1,125 @@
+#include "output.h"
+#include "format.h"
+#include "string_heap.h"
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#define OUTPUT_BUFFER_SIZE 65536
+
+static char buffer[OUTPUT_BUFFER_SIZE];
+static size_t buffer_length = 0;
+static bool registered = false;
+static enum FORMAT_DOUBLE_STYLE double_style = FORMAT_DOUBLE_FIXED;
+
+// Writes every iov, retrying after partial writes and signals
+static void write_all(struct iovec *iov, int count)
+{
+	while (count > 0) {
+		ssize_t written = writev(STDOUT_FILENO, iov, count);
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return; // Nothing sensible to do, the output is dropped
+		}
+
+		while (count > 0 && (size_t)written >= iov->iov_len) {
+			written -= iov->iov_len;
+			++iov;
+			--count;
+		}
+		if (count > 0) {
+			iov->iov_base = (char *)iov->iov_base + written;
+			iov->iov_len -= written;
+		}
+	}
+}
+
+void output_flush()
+{
+	if (buffer_length == 0) {
+		return;
+	}
+
+	struct iovec iov = { .iov_base = buffer, .iov_len = buffer_length };
+	write_all(&iov, 1);
+	buffer_length = 0;
+}
+
+// Makes sure len bytes fit in the buffer
+static char *reserve(size_t len)
+{
+	if (!registered) {
+		atexit(output_flush);
+		registered = true;
+	}
+	if (OUTPUT_BUFFER_SIZE - buffer_length < len) {
+		output_flush();
+	}
+	return buffer + buffer_length;
+}
+
+void output_write(const char *data, size_t len)
+{
+	if (len > OUTPUT_BUFFER_SIZE / 2) {
+		// Large writes skip the copy, the buffer goes out in the same call
+		reserve(0);
+		struct iovec iov[2] = {
+			{ .iov_base = buffer, .iov_len = buffer_length },
+			{ .iov_base = (char *)data, .iov_len = len },
+		};
+		write_all(iov, 2);
+		buffer_length = 0;
+		return;
+	}
+
+	memcpy(reserve(len), data, len);
+	buffer_length += len;
+}
+
+void output_str(const char *str)
+{
+	output_write(str, strlen(str));
+}
+
+void output_char(char c)
+{
+	*reserve(1) = c;
+	++buffer_length;
+}
+
+void output_int(int x)
+{
+	buffer_length += format_int(reserve(FORMAT_INT_MAX), x);
+}
+
+void output_double(double x)
+{
+	if (double_style == FORMAT_DOUBLE_SHORTEST) {
+		buffer_length += format_double_shortest(
+			reserve(FORMAT_DOUBLE_SHORTEST_MAX), x);
+	} else {
+		buffer_length += format_double_fixed(
+			reserve(FORMAT_DOUBLE_FIXED_MAX), x);
+	}
+}
+
+void output_set_double_style(enum FORMAT_DOUBLE_STYLE style)
+{
+	double_style = style;
+}
+
+void output_value(struct value val)
+{
+	if (value_is_int(val)) {
+		output_int(value_as_int(val));
+	} else if (value_is_str(val)) {
+		struct string *str = value_as_str(val);
+		output_write(str->data, str->length);
+	} else {
+		output_double(value_as_double(val));
+	}
+}
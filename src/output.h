@@ -0,0 +1,28 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdlib.h>
+#include "value.h"
+#include "format.h"
+
+/*
+ * Program output goes through one buffer that is written to stdout in large
+ * chunks. The buffer is flushed when it fills up, before a diagnostic is
+ * printed to stderr and when the process exits, so both streams stay in the
+ * order the program produced them.
+ */
+
+void output_write(const char *data, size_t len);
+void output_str(const char *str);
+void output_char(char c);
+void output_int(int x);
+void output_double(double x);
+
+// Prints a value the way PRINT shows it, without the newline
+void output_value(struct value val);
+
+void output_set_double_style(enum FORMAT_DOUBLE_STYLE style);
+
+void output_flush();
+
+#endif
@@ -1,67 +1,96 @@
 #include "ast.h"
 #include "lexer.h"
 #include "error.h"
-#include "stdio.h"
+#include "parser.h"
+#include <stdlib.h>
+#include <assert.h>
 
-static void parse_command(struct lexer *lexer, struct token curr_tok,
+static void parse_command(struct lexer *lexer, struct arena *arena,
 			  struct ast_node *node, struct error **err);
 
-struct ast_node *parse_tokens(struct lexer *lexer)
+static struct ast_node *create_node(struct lexer *lexer, struct arena *arena,
+				    struct token tok)
 {
-	struct error *err = NULL;
-	struct token curr_tok = lexer_next_token(lexer, &err);
-	if (err != NULL) {
-		error_print(err);
-		return NULL;
-	}
+	const char *text =
+		tok.type == TOKEN_EOF ? NULL : lexer->source + tok.offset;
+	return ast_node_create(arena, tok, lexer_locate(lexer, tok), text);
+}
 
+struct ast_node *parse_tokens(struct lexer *lexer, struct arena *arena)
+{
 	struct ast_node *root = ast_node_create(
-		(struct token){ .type = TOKEN_START, .value = "PROG" });
-
-	while (curr_tok.type != TOKEN_EOF) {
-		struct ast_node *curr_node = ast_node_create(curr_tok);
-		if (curr_tok.type == TOKEN_COMMAND) {
-			parse_command(lexer, curr_tok, curr_node, &err);
-			if (err != NULL) {
-				error_print(err);
-				return NULL;
-			}
-		}
-		ast_add_arg(root, curr_node);
+		arena, (struct token){ .type = TOKEN_START, .length = 4 },
+		(struct source_pos){ 0, 0 }, "PROG");
 
-		curr_tok = lexer_next_token(lexer, &err);
+	for (;;) {
+		struct error *err = NULL;
+		struct ast_node *curr_node = parse_statement(lexer, arena, &err);
 		if (err != NULL) {
 			error_print(err);
+			error_free(err);
 			return NULL;
 		}
+
+		ast_add_arg(root, curr_node);
+		if (curr_node->tok.type == TOKEN_EOF) {
+			return root;
+		}
 	}
-	struct ast_node *curr_node = ast_node_create(curr_tok);
-	ast_add_arg(root, curr_node); // Add EOF
+}
 
-	return root;
+struct ast_node *parse_statement(struct lexer *lexer, struct arena *arena,
+				 struct error **err)
+{
+	struct token tok = lexer_next_token(lexer, err);
+	if (*err != NULL) {
+		return NULL;
+	}
+
+	struct ast_node *node = create_node(lexer, arena, tok);
+	if (tok.type == TOKEN_COMMAND) {
+		parse_command(lexer, arena, node, err);
+		if (*err != NULL) {
+			return NULL;
+		}
+	}
+	return node;
 }
 
-static void parse_command(struct lexer *lexer, struct token curr_tok,
+#define INITIAL_STACK_SIZE 16
+
+// Subcommands are filled in on an explicit stack, nesting costs no C stack
+static void parse_command(struct lexer *lexer, struct arena *arena,
 			  struct ast_node *node, struct error **err)
 {
-	struct error *internal_err = NULL;
-	while (node->argc < curr_tok.max_argc) {
-		struct token tok = lexer_next_token(lexer, &internal_err);
-		if (internal_err != NULL) {
+	size_t capacity = INITIAL_STACK_SIZE;
+	size_t length = 0;
+	struct ast_node **stack = malloc(sizeof(*stack) * capacity);
+	assert(stack != NULL);
+	stack[length++] = node;
+
+	while (length > 0) {
+		struct ast_node *top = stack[length - 1];
+		if (top->argc == top->tok.command->max_argc) {
+			--length;
+			continue;
+		}
+
+		struct token tok = lexer_next_token(lexer, err);
+		if (*err != NULL) {
 			break;
 		}
-		struct ast_node *curr_node = ast_node_create(tok);
-		if (tok.type == TOKEN_SUBCOMMAND) {
-			ast_add_arg(node, curr_node);
+		struct ast_node *curr_node = create_node(lexer, arena, tok);
+		ast_add_arg(top, curr_node);
 
-			parse_command(lexer, tok, curr_node, &internal_err);
-			if (internal_err != NULL) {
-				break;
+		if (tok.type == TOKEN_SUBCOMMAND) {
+			if (length == capacity) {
+				capacity *= 2;
+				stack = realloc(stack, sizeof(*stack) * capacity);
+				assert(stack != NULL);
 			}
-			continue;
+			stack[length++] = curr_node;
 		}
-
-		ast_add_arg(node, curr_node);
 	}
-	*err = internal_err;
+
+	free(stack);
 }
@@ -3,7 +3,17 @@
 
 struct ast_node;
 struct lexer;
+struct arena;
 
-struct ast_node *parse_tokens(struct lexer *lexer);
+struct error;
+
+struct ast_node *parse_tokens(struct lexer *lexer, struct arena *arena);
+
+/*
+ * Parses the next top-level token, a command with all of its arguments.
+ * Gives an EOF node at the end of the source.
+ */
+struct ast_node *parse_statement(struct lexer *lexer, struct arena *arena,
+				 struct error **err);
 
 #endif
@@ -0,0 +1,209 @@
+#include "error.h"
+#include "ast.h"
+#include "command_funcs.h"
+#include "symbol_table.h"
+#include "string_heap.h"
+#include "resolver.h"
+#include <assert.h>
+
+struct resolver {
+	struct symbol_table *names; // Identifier to slot
+	size_t slot_count;
+	struct error *err;
+};
+
+static void resolve_statement(struct resolver *r, struct ast_node *node);
+static void resolve_value(struct resolver *r, struct ast_node *node);
+static void resolve_operand(struct resolver *r, struct ast_node *node);
+static void resolve_identifier(struct resolver *r, struct ast_node *node,
+			       struct symbol_call_data call_data);
+static bool expect_identifier(struct resolver *r, const struct ast_node *node);
+
+// Every CREATE adds one name, the table is sized for all of them upfront
+static size_t count_creates(const struct ast_node *ast)
+{
+	size_t count = 0;
+	for (size_t i = 0; i < ast->argc; ++i) {
+		count += ast->args[i]->tok.type == TOKEN_COMMAND &&
+			 ast->args[i]->func == command_func_create;
+	}
+	return count;
+}
+
+struct resolution resolve_ast(struct ast_node *ast)
+{
+	struct resolver *r = resolver_create(count_creates(ast));
+	struct error *err = NULL;
+
+	size_t i = 0;
+	for (; i < ast->argc; ++i) {
+		struct ast_node *current_command = ast->args[i];
+		if (current_command->tok.type == TOKEN_EOF) {
+			break;
+		}
+
+		resolver_resolve(r, current_command, &err);
+		if (err != NULL) {
+			break;
+		}
+	}
+
+	struct resolution res = { .slot_count = resolver_slot_count(r),
+				  .statement_count = i,
+				  .err = err };
+	resolver_free(r);
+	return res;
+}
+
+struct resolver *resolver_create(size_t size)
+{
+	struct resolver *r = malloc(sizeof(*r));
+	assert(r != NULL);
+
+	r->names = symbol_table_create(size);
+	r->slot_count = 0;
+	r->err = NULL;
+	return r;
+}
+
+void resolver_resolve(struct resolver *r, struct ast_node *statement,
+		      struct error **err)
+{
+	resolve_statement(r, statement);
+	*err = r->err;
+	r->err = NULL;
+}
+
+size_t resolver_slot_count(const struct resolver *r)
+{
+	return r->slot_count;
+}
+
+void resolver_free(struct resolver *r)
+{
+	symbol_table_free(r->names);
+	free(r);
+}
+
+static void resolve_statement(struct resolver *r, struct ast_node *node)
+{
+	if (node->tok.type != TOKEN_COMMAND) {
+		r->err = error_create(ERROR_PARSER, ERROR_SYNTAX_ERROR,
+				      node->pos.line, node->pos.column,
+				      "Expected a command");
+		return;
+	}
+
+	if (node->func == command_func_create) {
+		struct ast_node *identifier = node->args[0];
+
+		resolve_value(r, node->args[1]);
+		if (r->err != NULL || !expect_identifier(r, identifier)) {
+			return;
+		}
+
+		identifier->slot = r->slot_count;
+		symbol_table_insert(
+			r->names, identifier->string->data,
+			value_int(identifier->slot),
+			(struct symbol_call_data){ identifier->pos.line,
+						   identifier->pos.column },
+			&r->err);
+		if (r->err == NULL) {
+			++r->slot_count;
+		}
+	} else if (node->func == command_func_set) {
+		resolve_value(r, node->args[1]);
+		if (r->err != NULL || !expect_identifier(r, node->args[0])) {
+			return;
+		}
+
+		// Unknown variables are reported at the SET itself
+		resolve_identifier(r, node->args[0],
+				   (struct symbol_call_data){
+					   node->pos.line, node->pos.column });
+	} else if (node->func == command_func_print) {
+		// Literals are printed as they were written, never evaluated
+		enum TOKEN_TYPE type = node->args[0]->tok.type;
+		if (type != TOKEN_INT && type != TOKEN_DOUBLE &&
+		    type != TOKEN_STR) {
+			resolve_value(r, node->args[0]);
+		}
+	}
+}
+
+static void resolve_value(struct resolver *r, struct ast_node *node)
+{
+	struct ast_walk walk;
+	ast_walk_init(&walk, node);
+
+	// Operands are checked left to right, the first bad one is reported
+	struct ast_node *curr;
+	while (r->err == NULL && (curr = ast_walk_next(&walk)) != NULL) {
+		resolve_operand(r, curr);
+	}
+
+	ast_walk_free(&walk);
+}
+
+static void resolve_operand(struct resolver *r, struct ast_node *node)
+{
+	switch (node->tok.type) {
+	case TOKEN_INT:
+		if (node->tok.int_overflow) {
+			r->err = error_create(
+				ERROR_INTERPRETER, ERROR_RUNTIME_ERROR,
+				node->pos.line, node->pos.column,
+				"Integer exceeds the max int limit");
+		}
+		return;
+	case TOKEN_DOUBLE:
+	case TOKEN_STR:
+	case TOKEN_SUBCOMMAND: // Its operands come before it in the walk
+		return;
+	case TOKEN_IDENTIFIER:
+		resolve_identifier(r, node,
+				   (struct symbol_call_data){
+					   node->pos.line, node->pos.column });
+		return;
+	case TOKEN_EOF:
+		r->err = error_create(ERROR_PARSER, ERROR_UNEXPECTED_EOF,
+				      node->pos.line, node->pos.column,
+				      "Unexpected end of file, expected a value");
+		return;
+	default:
+		r->err = error_create(ERROR_PARSER, ERROR_SYNTAX_ERROR,
+				      node->pos.line, node->pos.column,
+				      "Expected a value");
+		return;
+	}
+}
+
+static void resolve_identifier(struct resolver *r, struct ast_node *node,
+			       struct symbol_call_data call_data)
+{
+	struct symbol *sym =
+		symbol_table_find(r->names, node->string->data, call_data, &r->err);
+	if (sym != NULL) {
+		node->slot = value_as_int(sym->value);
+	}
+}
+
+static bool expect_identifier(struct resolver *r, const struct ast_node *node)
+{
+	if (node->tok.type == TOKEN_IDENTIFIER) {
+		return true;
+	}
+
+	if (node->tok.type == TOKEN_EOF) {
+		r->err = error_create(
+			ERROR_PARSER, ERROR_UNEXPECTED_EOF, node->pos.line,
+			node->pos.column,
+			"Unexpected end of file, expected an identifier");
+	} else {
+		r->err = error_create(ERROR_PARSER, ERROR_SYNTAX_ERROR,
+				      node->pos.line, node->pos.column,
+				      "Expected an identifier");
+	}
+	return false;
+}
@@ -0,0 +1,35 @@
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include <stdlib.h>
+
+struct ast_node;
+struct error;
+struct resolver;
+
+struct resolution {
+	size_t slot_count; // Count of variables, numbered from 0
+	size_t statement_count; // Statements before the one that failed
+	struct error *err; // Raised when the failed statement is reached
+};
+
+/*
+ * Gives every CREATE a slot and stores the slot of each variable reference
+ * in its node, so no names are looked up at runtime. Unknown and duplicate
+ * identifiers and malformed statements are found here. Programs are
+ * straight-line code, so the engines run the statements before the first
+ * error and then raise it, the same point where evaluating it would fail.
+ */
+struct resolution resolve_ast(struct ast_node *ast);
+
+/*
+ * Resolves a program one statement at a time, slots stay valid throughout.
+ * size is a hint of how many variables the program creates.
+ */
+struct resolver *resolver_create(size_t size);
+void resolver_resolve(struct resolver *r, struct ast_node *statement,
+		      struct error **err);
+size_t resolver_slot_count(const struct resolver *r);
+void resolver_free(struct resolver *r);
+
+#endif
@@ -0,0 +1,223 @@
+#include "scan.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+static bool is_space(unsigned char c)
+{
+	return c == ' ' || (unsigned char)(c - '\t') <= '\r' - '\t';
+}
+
+static size_t find2_scalar(const char *s, size_t n, char a, char b)
+{
+	for (size_t i = 0; i < n; ++i) {
+		if (s[i] == a || s[i] == b) {
+			return i;
+		}
+	}
+	return n;
+}
+
+static size_t skip_space_scalar(const char *s, size_t n)
+{
+	for (size_t i = 0; i < n; ++i) {
+		if (!is_space(s[i])) {
+			return i;
+		}
+	}
+	return n;
+}
+
+static size_t count_scalar(const char *s, size_t n, char c)
+{
+	size_t count = 0;
+	for (size_t i = 0; i < n; ++i) {
+		count += s[i] == c;
+	}
+	return count;
+}
+
+#ifdef SCAN_X86
+
+static size_t find2_sse2(const char *s, size_t n, char a, char b)
+{
+	const __m128i va = _mm_set1_epi8(a);
+	const __m128i vb = _mm_set1_epi8(b);
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+		unsigned int mask = _mm_movemask_epi8(_mm_or_si128(
+			_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb)));
+		if (mask != 0) {
+			return i + __builtin_ctz(mask);
+		}
+	}
+	return i + find2_scalar(s + i, n - i, a, b);
+}
+
+// Set for ' ' and for '\t' through '\r'
+static __m128i space_mask_sse2(__m128i v)
+{
+	__m128i ctrl = _mm_sub_epi8(v, _mm_set1_epi8('\t'));
+	__m128i is_ctrl = _mm_cmpeq_epi8(
+		_mm_min_epu8(ctrl, _mm_set1_epi8('\r' - '\t')), ctrl);
+	return _mm_or_si128(is_ctrl, _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+}
+
+static size_t skip_space_sse2(const char *s, size_t n)
+{
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+		unsigned int mask =
+			~_mm_movemask_epi8(space_mask_sse2(v)) & 0xFFFF;
+		if (mask != 0) {
+			return i + __builtin_ctz(mask);
+		}
+	}
+	return i + skip_space_scalar(s + i, n - i);
+}
+
+static size_t count_sse2(const char *s, size_t n, char c)
+{
+	const __m128i vc = _mm_set1_epi8(c);
+	size_t count = 0;
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+		count += __builtin_popcount(
+			_mm_movemask_epi8(_mm_cmpeq_epi8(v, vc)));
+	}
+	return count + count_scalar(s + i, n - i, c);
+}
+
+__attribute__((target("avx2"))) static size_t
+find2_avx2(const char *s, size_t n, char a, char b)
+{
+	const __m256i va = _mm256_set1_epi8(a);
+	const __m256i vb = _mm256_set1_epi8(b);
+	size_t i = 0;
+	for (; i + 32 <= n; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(s + i));
+		unsigned int mask = _mm256_movemask_epi8(_mm256_or_si256(
+			_mm256_cmpeq_epi8(v, va), _mm256_cmpeq_epi8(v, vb)));
+		if (mask != 0) {
+			return i + __builtin_ctz(mask);
+		}
+	}
+	return i + find2_sse2(s + i, n - i, a, b);
+}
+
+__attribute__((target("avx2"))) static size_t
+skip_space_avx2(const char *s, size_t n)
+{
+	size_t i = 0;
+	for (; i + 32 <= n; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(s + i));
+		__m256i ctrl = _mm256_sub_epi8(v, _mm256_set1_epi8('\t'));
+		__m256i is_ctrl = _mm256_cmpeq_epi8(
+			_mm256_min_epu8(ctrl, _mm256_set1_epi8('\r' - '\t')),
+			ctrl);
+		__m256i space = _mm256_or_si256(
+			is_ctrl, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')));
+		unsigned int mask = ~_mm256_movemask_epi8(space);
+		if (mask != 0) {
+			return i + __builtin_ctz(mask);
+		}
+	}
+	return i + skip_space_sse2(s + i, n - i);
+}
+
+__attribute__((target("avx2"))) static size_t
+count_avx2(const char *s, size_t n, char c)
+{
+	const __m256i vc = _mm256_set1_epi8(c);
+	size_t count = 0;
+	size_t i = 0;
+	for (; i + 32 <= n; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(s + i));
+		count += __builtin_popcount(
+			_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, vc)));
+	}
+	return count + count_sse2(s + i, n - i, c);
+}
+
+static size_t find2_dispatch(const char *s, size_t n, char a, char b);
+static size_t skip_space_dispatch(const char *s, size_t n);
+static size_t count_dispatch(const char *s, size_t n, char c);
+
+static size_t (*find2_impl)(const char *, size_t, char,
+			    char) = find2_dispatch;
+static size_t (*skip_space_impl)(const char *, size_t) = skip_space_dispatch;
+static size_t (*count_impl)(const char *, size_t, char) = count_dispatch;
+
+// Replaces the implementations the first time any of them is called
+static void select_impl()
+{
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		find2_impl = find2_avx2;
+		skip_space_impl = skip_space_avx2;
+		count_impl = count_avx2;
+	} else {
+		find2_impl = find2_sse2;
+		skip_space_impl = skip_space_sse2;
+		count_impl = count_sse2;
+	}
+}
+
+static size_t find2_dispatch(const char *s, size_t n, char a, char b)
+{
+	select_impl();
+	return find2_impl(s, n, a, b);
+}
+
+static size_t skip_space_dispatch(const char *s, size_t n)
+{
+	select_impl();
+	return skip_space_impl(s, n);
+}
+
+static size_t count_dispatch(const char *s, size_t n, char c)
+{
+	select_impl();
+	return count_impl(s, n, c);
+}
+
+size_t scan_find2(const char *s, size_t n, char a, char b)
+{
+	return find2_impl(s, n, a, b);
+}
+
+size_t scan_skip_space(const char *s, size_t n)
+{
+	return skip_space_impl(s, n);
+}
+
+size_t scan_count(const char *s, size_t n, char c)
+{
+	return count_impl(s, n, c);
+}
+
+#else
+
+size_t scan_find2(const char *s, size_t n, char a, char b)
+{
+	return find2_scalar(s, n, a, b);
+}
+
+size_t scan_skip_space(const char *s, size_t n)
+{
+	return skip_space_scalar(s, n);
+}
+
+size_t scan_count(const char *s, size_t n, char c)
+{
+	return count_scalar(s, n, c);
+}
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stdlib.h>
+
+/*
+ * Byte scanning used by the lexer. On x86 the SSE2 or AVX2 version is picked
+ * once at runtime, 16 or 32 bytes are checked per step. Other targets use the
+ * scalar versions.
+ */
+
+// Offset of the first byte equal to a or b, n if there is none
+size_t scan_find2(const char *s, size_t n, char a, char b);
+
+// Offset of the first byte that is not a space as defined by isspace
+size_t scan_skip_space(const char *s, size_t n);
+
+// Count of bytes equal to c
+size_t scan_count(const char *s, size_t n, char c);
+
+#endif
@@ -1,118 +1,308 @@
 #include "error.h"
 #include "scope_table.h"
+#include "string_heap.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdbool.h>
 #include <assert.h>
 
-#define INITIAL_SIZE 8
-#define LOAD_FACTOR_THRESHOLD 0.75
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
-static void resize_table(struct scope_table *table);
+#define GROUP_SIZE 16
+#define CTRL_EMPTY 0x80
+#define CTRL_DELETED 0xFE
+// Old slots moved by each insert while growing
+#define MIGRATE_SLOTS 32
 
-static unsigned int hash_function(const char *key, size_t size)
+static uint64_t hash_function(const char *key, size_t len)
 {
-	unsigned long int value = 0;
-	size_t i = 0;
-	size_t key_len = strlen(key);
+	const uint64_t m = 0x9E3779B97F4A7C15ull;
+	uint64_t value = len * m;
 
-	for (; i < key_len; ++i)
-		value = value * 37 + key[i];
+	for (; len >= 8; key += 8, len -= 8) {
+		uint64_t word;
+		memcpy(&word, key, 8);
+		value = (value ^ word) * m;
+		value ^= value >> 29;
+	}
+	uint64_t tail = 0;
+	memcpy(&tail, key, len);
+	value = (value ^ tail) * m;
 
-	return value % size;
+	return value ^ (value >> 32);
 }
 
-static struct symbol *create_symbol(const char *identifier,
-				    enum SYMBOL_TYPE type,
-				    union symbol_val value, size_t line,
-				    size_t column)
+// The low 7 bits go into the control byte, the rest picks the group
+static uint8_t hash_ctrl(uint64_t hash)
 {
-	struct symbol *new_symbol = malloc(sizeof(struct symbol));
-	assert(new_symbol != NULL);
+	return hash & 0x7F;
+}
 
-	new_symbol->identifier = strdup(identifier);
-	assert(new_symbol->identifier != NULL);
+static size_t max_load(size_t capacity)
+{
+	return capacity - capacity / 8;
+}
 
-	new_symbol->type = type;
-	new_symbol->value = value;
-	new_symbol->line = line;
-	new_symbol->column = column;
-	new_symbol->next = NULL;
-	return new_symbol;
+// Bit i is set if control byte i of the group is equal to c
+static unsigned int group_match(const uint8_t *group, uint8_t c)
+{
+#ifdef __SSE2__
+	__m128i ctrl = _mm_loadu_si128((const __m128i *)group);
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(c)));
+#else
+	unsigned int mask = 0;
+	for (int i = 0; i < GROUP_SIZE; ++i) {
+		mask |= (unsigned int)(group[i] == c) << i;
+	}
+	return mask;
+#endif
+}
+
+// Bit i is set if slot i of the group is empty or deleted
+static unsigned int group_match_free(const uint8_t *group)
+{
+#ifdef __SSE2__
+	__m128i ctrl = _mm_loadu_si128((const __m128i *)group);
+	return _mm_movemask_epi8(ctrl);
+#else
+	unsigned int mask = 0;
+	for (int i = 0; i < GROUP_SIZE; ++i) {
+		mask |= (unsigned int)(group[i] >> 7) << i;
+	}
+	return mask;
+#endif
+}
+
+static struct symbol *find_slot(const struct scope_slots *slots,
+				const char *identifier, size_t len,
+				uint64_t hash)
+{
+	size_t groups = slots->capacity / GROUP_SIZE;
+	size_t group = (hash >> 7) & (groups - 1);
+	uint8_t ctrl = hash_ctrl(hash);
+
+	// Triangular probing visits every group once
+	for (size_t step = 1; step <= groups; ++step) {
+		const uint8_t *ctrls = slots->ctrl + group * GROUP_SIZE;
+		unsigned int match = group_match(ctrls, ctrl);
+		while (match) {
+			size_t i = group * GROUP_SIZE + __builtin_ctz(match);
+			struct symbol *symbol = &slots->symbols[i];
+			if (symbol->hash == hash &&
+			    strncmp(symbol->identifier, identifier, len) == 0 &&
+			    symbol->identifier[len] == '\0') {
+				return symbol;
+			}
+			match &= match - 1;
+		}
+		if (group_match(ctrls, CTRL_EMPTY)) {
+			return NULL;
+		}
+		group = (group + step) & (groups - 1);
+	}
+	return NULL;
+}
+
+// Looks in the slots that are still being moved as well
+static struct symbol *find_symbol(struct scope_table *table,
+				  const char *identifier, size_t len,
+				  uint64_t hash, struct scope_slots **owner)
+{
+	struct symbol *symbol =
+		find_slot(&table->slots, identifier, len, hash);
+	if (symbol != NULL) {
+		*owner = &table->slots;
+		return symbol;
+	}
+	if (table->old.ctrl == NULL) {
+		return NULL;
+	}
+	*owner = &table->old;
+	return find_slot(&table->old, identifier, len, hash);
+}
+
+// Index of the first empty or deleted slot on the probe sequence of hash
+static size_t find_free_slot(const struct scope_slots *slots, uint64_t hash)
+{
+	size_t groups = slots->capacity / GROUP_SIZE;
+	size_t group = (hash >> 7) & (groups - 1);
+
+	for (size_t step = 1;; ++step) {
+		unsigned int free_slots =
+			group_match_free(slots->ctrl + group * GROUP_SIZE);
+		if (free_slots) {
+			return group * GROUP_SIZE + __builtin_ctz(free_slots);
+		}
+		group = (group + step) & (groups - 1);
+	}
+}
+
+static void set_identifier(struct symbol *symbol, const char *identifier,
+			   size_t len)
+{
+	if (len < SYMBOL_INLINE_NAME) {
+		memcpy(symbol->name, identifier, len + 1);
+		symbol->identifier = symbol->name;
+	} else {
+		symbol->identifier = strdup(identifier);
+		assert(symbol->identifier != NULL);
+	}
+}
+
+static void free_identifier(struct symbol *symbol)
+{
+	if (symbol->identifier != symbol->name) {
+		free((char *)symbol->identifier);
+	}
+}
+
+static size_t round_capacity(size_t size)
+{
+	size_t capacity = GROUP_SIZE;
+	while (max_load(capacity) < size) {
+		capacity *= 2;
+	}
+	return capacity;
+}
+
+static void alloc_slots(struct scope_slots *slots, size_t capacity)
+{
+	slots->capacity = capacity;
+
+	slots->ctrl = malloc(capacity);
+	assert(slots->ctrl != NULL);
+	memset(slots->ctrl, CTRL_EMPTY, capacity);
+
+	slots->symbols = malloc(capacity * sizeof(struct symbol));
+	assert(slots->symbols != NULL);
 }
 
-struct scope_table *scope_table_create(struct scope_table *parent, size_t size)
+static void free_slots(struct scope_slots *slots)
+{
+	for (size_t i = 0; i < slots->capacity; i++) {
+		if (!(slots->ctrl[i] & CTRL_EMPTY)) {
+			free_identifier(&slots->symbols[i]);
+		}
+	}
+	free(slots->ctrl);
+	free(slots->symbols);
+}
+
+struct scope_table *scope_table_create(size_t size)
 {
 	struct scope_table *table = malloc(sizeof(struct scope_table));
 	assert(table != NULL);
 
-	table->parent = parent;
-	table->size = size;
+	alloc_slots(&table->slots, round_capacity(size));
+	table->old = (struct scope_slots){ NULL, NULL, 0 };
+	table->migrated = 0;
 	table->count = 0;
-
-	table->symbols = calloc(table->size, sizeof(struct symbol *));
-	assert(table->symbols != NULL);
+	table->growth_left = max_load(table->slots.capacity);
 
 	return table;
 }
 
-static void free_symbol(struct symbol *symbol)
+// Moves the symbol with its cached hash, the old slot is left deleted
+static void move_symbol(struct scope_table *table, size_t i)
 {
-	free(symbol->identifier);
-	free(symbol);
+	struct symbol *symbol = &table->old.symbols[i];
+	size_t j = find_free_slot(&table->slots, symbol->hash);
+	table->slots.ctrl[j] = hash_ctrl(symbol->hash);
+	table->slots.symbols[j] = *symbol;
+	if (symbol->identifier == symbol->name) {
+		table->slots.symbols[j].identifier =
+			table->slots.symbols[j].name;
+	}
+	table->old.ctrl[i] = CTRL_DELETED;
 }
 
-void scope_table_insert(struct scope_table *table, const char *identifier,
-			enum SYMBOL_TYPE type, union symbol_val value,
-			struct symbol_call_data call_data, struct error **err)
-{
-	if ((float)table->count / table->size > LOAD_FACTOR_THRESHOLD) {
-		resize_table(table);
-	}
-
-	// Check for duplicates in the current scope
-	unsigned int index = hash_function(identifier, table->size);
-	struct symbol *existing_symbol = table->symbols[index];
-	while (existing_symbol) {
-		if (strcmp(existing_symbol->identifier, identifier) == 0) {
-			*err = error_create(
-				ERROR_INTERPRETER, ERROR_DUPLICATE_IDENTIFIER,
-				call_data.line, call_data.column,
-				"Found a variable with same identifier '%s', this identifier was first used in line: %d, column: %d",
-				identifier, existing_symbol->line,
-				existing_symbol->column);
-			return;
-		}
-		existing_symbol = existing_symbol->next;
-	}
-
-	// Check for duplicates in parent scopes
-	struct scope_table *parent = table->parent;
-	while (parent) {
-		unsigned int parent_index =
-			hash_function(identifier, parent->size);
-		struct symbol *parent_symbol = parent->symbols[parent_index];
-		while (parent_symbol) {
-			if (strcmp(parent_symbol->identifier, identifier) ==
-			    0) {
-				*err = error_create(
-					ERROR_INTERPRETER,
-					ERROR_DUPLICATE_IDENTIFIER,
-					call_data.line, call_data.column,
-					"Found a variable with same identifier '%s', this identifier was first used in line: %d, column: %d",
-					identifier, existing_symbol->line,
-					existing_symbol->column);
-			}
-			parent_symbol = parent_symbol->next;
+static void migrate(struct scope_table *table, size_t slots)
+{
+	size_t end = table->migrated + slots;
+	if (end > table->old.capacity) {
+		end = table->old.capacity;
+	}
+
+	for (size_t i = table->migrated; i < end; i++) {
+		if (!(table->old.ctrl[i] & CTRL_EMPTY)) {
+			move_symbol(table, i);
 		}
-		parent = parent->parent;
+	}
+	table->migrated = end;
+
+	if (table->migrated == table->old.capacity) {
+		free(table->old.ctrl);
+		free(table->old.symbols);
+		table->old = (struct scope_slots){ NULL, NULL, 0 };
+	}
+}
+
+/*
+ * Starts moving into new slots, deleted slots are dropped on the way. The
+ * new slots have room for every symbol of the old ones, and at least an
+ * eighth of the old capacity is left for inserts, which drain the old
+ * slots well before that runs out.
+ */
+static void start_resize(struct scope_table *table, size_t capacity)
+{
+	// Only happens if a resize could not keep up, which the rate prevents
+	if (table->old.ctrl != NULL) {
+		migrate(table, table->old.capacity);
+	}
+
+	table->old = table->slots;
+	table->migrated = 0;
+	alloc_slots(&table->slots, capacity);
+	table->growth_left = max_load(capacity) - table->count;
+}
+
+void scope_table_insert(struct scope_table *table, const char *identifier,
+			struct value value, struct symbol_call_data call_data,
+			struct error **err)
+{
+	size_t len = strlen(identifier);
+	uint64_t hash = hash_function(identifier, len);
+
+	struct scope_slots *owner;
+	struct symbol *existing_symbol =
+		find_symbol(table, identifier, len, hash, &owner);
+	if (existing_symbol) {
+		*err = error_create(
+			ERROR_INTERPRETER, ERROR_DUPLICATE_IDENTIFIER,
+			call_data.line, call_data.column,
+			"Found a variable with same identifier '%s', this identifier was first used in line: %d, column: %d",
+			identifier, (int)existing_symbol->line,
+			(int)existing_symbol->column);
+		return;
+	}
+
+	if (table->old.ctrl != NULL) {
+		migrate(table, MIGRATE_SLOTS);
+	}
+
+	if (table->growth_left == 0) {
+		// Rehashing at the same size is enough if most of the load is deleted
+		size_t capacity = table->slots.capacity;
+		bool mostly_deleted = table->count < max_load(capacity) / 2;
+		start_resize(table, mostly_deleted ? capacity : capacity * 2);
+		migrate(table, MIGRATE_SLOTS);
 	}
 
-	struct symbol *new_symbol = create_symbol(
-		identifier, type, value, call_data.line, call_data.column);
+	size_t i = find_free_slot(&table->slots, hash);
+	if (table->slots.ctrl[i] == CTRL_EMPTY) {
+		--table->growth_left;
+	}
+	table->slots.ctrl[i] = hash_ctrl(hash);
 
-	new_symbol->next = table->symbols[index];
-	table->symbols[index] = new_symbol;
+	struct symbol *new_symbol = &table->slots.symbols[i];
+	set_identifier(new_symbol, identifier, len);
+	new_symbol->hash = hash;
+	new_symbol->value = value;
+	new_symbol->line = call_data.line;
+	new_symbol->column = call_data.column;
 	table->count++;
 }
 
@@ -121,13 +311,12 @@ struct symbol *scope_table_find(struct scope_table *table,
 				struct symbol_call_data call_data,
 				struct error **err)
 {
-	unsigned int index = hash_function(identifier, table->size);
-	struct symbol *symbol = table->symbols[index];
-	while (symbol) {
-		if (strcmp(symbol->identifier, identifier) == 0) {
-			return symbol;
-		}
-		symbol = symbol->next;
+	size_t len = strlen(identifier);
+	struct scope_slots *owner;
+	struct symbol *symbol = find_symbol(
+		table, identifier, len, hash_function(identifier, len), &owner);
+	if (symbol || err == NULL) {
+		return symbol;
 	}
 	*err = error_create(ERROR_INTERPRETER, ERROR_INVALID_IDENTIFIER,
 			    call_data.line, call_data.column,
@@ -138,89 +327,57 @@ struct symbol *scope_table_find(struct scope_table *table,
 
 void scope_table_delete(struct scope_table *table, const char *identifier)
 {
-	unsigned int index = hash_function(identifier, table->size);
-	struct symbol *symbol = table->symbols[index];
-	struct symbol *prev = NULL;
-	while (symbol) {
-		if (strcmp(symbol->identifier, identifier) == 0) {
-			if (prev) {
-				prev->next = symbol->next;
-			} else {
-				table->symbols[index] = symbol->next;
-			}
-			free_symbol(symbol);
-			table->count--;
-			return;
-		}
-		prev = symbol;
-		symbol = symbol->next;
+	size_t len = strlen(identifier);
+	struct scope_slots *owner;
+	struct symbol *symbol = find_symbol(
+		table, identifier, len, hash_function(identifier, len), &owner);
+	if (!symbol) {
+		return;
 	}
+
+	free_identifier(symbol);
+	owner->ctrl[symbol - owner->symbols] = CTRL_DELETED;
+	table->count--;
 }
 
 void scope_table_free(struct scope_table *table)
 {
-	for (size_t i = 0; i < table->size; i++) {
-		struct symbol *symbol = table->symbols[i];
-		while (symbol) {
-			struct symbol *temp = symbol;
-			symbol = symbol->next;
-			free_symbol(temp);
-		}
+	free_slots(&table->slots);
+	if (table->old.ctrl != NULL) {
+		free_slots(&table->old);
 	}
-	free(table->symbols);
 	free(table);
 }
 
-void scope_table_print(struct scope_table *table)
+static void print_slots(const struct scope_slots *slots)
 {
-	printf("Scope Table Contents:\n");
-	for (size_t i = 0; i < table->size; i++) {
-		struct symbol *node = table->symbols[i];
-		if (node) {
-			printf("Bucket %zu:\n", i);
-			while (node) {
-				if (node->type == SYMBOL_INT) {
-					printf("  Key: %s, Value: %d\n",
-					       node->identifier,
-					       node->value.int_val);
-				}
-				if (node->type == SYMBOL_DOUBLE) {
-					printf("  Key: %s, Value: %f\n",
-					       node->identifier,
-					       node->value.double_val);
-				}
-				if (node->type == SYMBOL_STR) {
-					printf("  Key: %s, Value: %s\n",
-					       node->identifier,
-					       node->value.str_val);
-				}
-				node = node->next;
-			}
+	for (size_t i = 0; i < slots->capacity; i++) {
+		if (slots->ctrl[i] & CTRL_EMPTY) {
+			continue;
+		}
+		struct symbol *node = &slots->symbols[i];
+		printf("Slot %zu:\n", i);
+		if (value_is_int(node->value)) {
+			printf("  Key: %s, Value: %d\n", node->identifier,
+			       value_as_int(node->value));
+		}
+		if (value_is_double(node->value)) {
+			printf("  Key: %s, Value: %f\n", node->identifier,
+			       value_as_double(node->value));
+		}
+		if (value_is_str(node->value)) {
+			printf("  Key: %s, Value: %s\n", node->identifier,
+			       value_as_str(node->value)->data);
 		}
 	}
 }
 
-static void resize_table(struct scope_table *table)
+void scope_table_print(struct scope_table *table)
 {
-	size_t new_size = table->size * 2;
-	struct scope_table *new_table =
-		scope_table_create(table->parent, new_size);
-
-	for (size_t i = 0; i < table->size; i++) {
-		struct symbol *symbol = table->symbols[i];
-		while (symbol) {
-			scope_table_insert(new_table, symbol->identifier,
-					   symbol->type, symbol->value,
-					   (struct symbol_call_data){ 0, 0 },
-					   NULL);
-			struct symbol *temp = symbol;
-			symbol = symbol->next;
-			free_symbol(temp);
-		}
+	printf("Scope Table Contents:\n");
+	print_slots(&table->slots);
+	if (table->old.ctrl != NULL) {
+		printf("Moving:\n");
+		print_slots(&table->old);
 	}
-
-	free(table->symbols);
-	table->symbols = new_table->symbols;
-	table->size = new_table->size;
-	free(new_table);
 }
@@ -2,28 +2,21 @@
 #define SCOPE_TABLE_H
 
 #include <stddef.h>
+#include <stdint.h>
+#include "value.h"
 
 struct error;
 
-enum SYMBOL_TYPE {
-	SYMBOL_INT,
-	SYMBOL_DOUBLE,
-	SYMBOL_STR,
-};
-
-union symbol_val {
-	int int_val;
-	double double_val;
-	char *str_val;
-};
+// Identifiers shorter than this are stored in the symbol itself
+#define SYMBOL_INLINE_NAME 24
 
 struct symbol {
-	char *identifier;
-	enum SYMBOL_TYPE type;
-	union symbol_val value;
-	struct symbol *next;
+	const char *identifier; // name or a heap copy for long identifiers
+	uint64_t hash;
+	struct value value;
 	size_t line;
 	size_t column;
+	char name[SYMBOL_INLINE_NAME];
 };
 
 struct symbol_call_data {
@@ -31,18 +24,39 @@ struct symbol_call_data {
 	size_t column;
 };
 
+struct scope_slots {
+	uint8_t *ctrl; // capacity control bytes
+	struct symbol *symbols; // capacity slots
+	size_t capacity; // Power of two, at least one group
+};
+
+/*
+ * Open addressing table in the style of a Swiss table. Every slot has a
+ * control byte that is either empty, deleted or 7 bits of the hash, a probe
+ * checks the control bytes of a group of 16 slots at once.
+ *
+ * Growing does not move everything at once: the previous slots stay in old
+ * and every insert moves a few of them, lookups check both until old is
+ * drained.
+ */
 struct scope_table {
-	struct symbol **symbols;
-	struct scope_table *parent;
-	size_t size;
-	size_t count;
+	struct scope_slots slots;
+	struct scope_slots old; // Still being moved if old.ctrl is not NULL
+	size_t migrated; // Slots of old before this index are moved
+	size_t count; // Symbols in slots and old
+	size_t growth_left; // Inserts left before the table has to grow
 };
 
-struct scope_table *scope_table_create(struct scope_table *parent, size_t size);
+// size is how many symbols fit before the first resize
+struct scope_table *scope_table_create(size_t size);
 void scope_table_free(struct scope_table *table);
 void scope_table_insert(struct scope_table *table, const char *identifier,
-			enum SYMBOL_TYPE type, union symbol_val value,
-			struct symbol_call_data call_data, struct error **err);
+			struct value value, struct symbol_call_data call_data,
+			struct error **err);
+/*
+ * The returned symbol is only valid until the next insert. err may be NULL
+ * when a miss is expected, nothing is allocated for it then.
+ */
 struct symbol *scope_table_find(struct scope_table *table,
 				const char *identifier,
 				struct symbol_call_data call_data,
@@ -0,0 +1,179 @@
+#include "source.h"
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define INITIAL_READ_SIZE 65536
+
+static bool map_file(struct source *source, int fd)
+{
+	struct stat st;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+		return false;
+	}
+
+	if (st.st_size == 0) {
+		source->data = "";
+		source->length = 0;
+		source->mapped = false;
+		return true;
+	}
+
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED) {
+		return false;
+	}
+	madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+	source->data = data;
+	source->length = st.st_size;
+	source->mapped = true;
+	return true;
+}
+
+static bool read_file(struct source *source, int fd)
+{
+	size_t allocated = INITIAL_READ_SIZE;
+	size_t length = 0;
+	char *buf = malloc(allocated);
+	assert(buf != NULL);
+
+	for (;;) {
+		if (length == allocated) {
+			allocated *= 2;
+			buf = realloc(buf, allocated);
+			assert(buf != NULL);
+		}
+
+		ssize_t n = read(fd, buf + length, allocated - length);
+		if (n == 0) {
+			break;
+		}
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			free(buf);
+			return false;
+		}
+		length += n;
+	}
+
+	if (length == 0) {
+		free(buf);
+		source->data = "";
+	} else {
+		source->data = buf;
+	}
+	source->length = length;
+	source->mapped = false;
+	return true;
+}
+
+struct source *source_open(const char *filename)
+{
+	bool is_stdin = strcmp(filename, "-") == 0;
+	int fd = is_stdin ? STDIN_FILENO : open(filename, O_RDONLY);
+	if (fd < 0) {
+		return NULL;
+	}
+
+	struct source *source = malloc(sizeof(*source));
+	assert(source != NULL);
+
+	bool ok = map_file(source, fd) || read_file(source, fd);
+	if (!is_stdin) {
+		close(fd);
+	}
+
+	if (!ok) {
+		free(source);
+		return NULL;
+	}
+	return source;
+}
+
+void source_close(struct source *source)
+{
+	if (!source)
+		return;
+
+	if (source->mapped) {
+		munmap((void *)source->data, source->length);
+	} else if (source->length > 0) {
+		free((char *)source->data);
+	}
+	free(source);
+}
+
+struct source_stream *source_stream_open(const char *filename)
+{
+	bool is_stdin = strcmp(filename, "-") == 0;
+	int fd = is_stdin ? STDIN_FILENO : open(filename, O_RDONLY);
+	if (fd < 0) {
+		return NULL;
+	}
+
+	struct source_stream *stream = malloc(sizeof(*stream));
+	assert(stream != NULL);
+
+	stream->fd = fd;
+	stream->data = malloc(INITIAL_READ_SIZE);
+	assert(stream->data != NULL);
+	stream->length = 0;
+	stream->capacity = INITIAL_READ_SIZE;
+	stream->eof = false;
+	return stream;
+}
+
+bool source_stream_fill(struct source_stream *stream, size_t consumed)
+{
+	memmove(stream->data, stream->data + consumed,
+		stream->length - consumed);
+	stream->length -= consumed;
+
+	bool grow = stream->length == stream->capacity;
+	if (grow) {
+		stream->capacity *= 2;
+		stream->data = realloc(stream->data, stream->capacity);
+		assert(stream->data != NULL);
+	}
+
+	for (;;) {
+		ssize_t n = read(stream->fd, stream->data + stream->length,
+				 stream->capacity - stream->length);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		if (n == 0) {
+			stream->eof = true;
+			break;
+		}
+
+		stream->length += n;
+		if (!grow || stream->length == stream->capacity) {
+			break;
+		}
+	}
+
+	return true;
+}
+
+void source_stream_close(struct source_stream *stream)
+{
+	if (!stream)
+		return;
+
+	if (stream->fd != STDIN_FILENO) {
+		close(stream->fd);
+	}
+	free(stream->data);
+	free(stream);
+}
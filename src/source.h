@@ -0,0 +1,48 @@
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+// Line and column of a byte in the source, both start from 1
+struct source_pos {
+	size_t line;
+	size_t column;
+};
+
+// Read-only program text, not NUL terminated
+struct source {
+	const char *data;
+	size_t length;
+	bool mapped; // data is mmap'd, otherwise it is owned heap memory
+};
+
+/*
+ * Regular files are mmap'd, anything that can not be mapped (pipes, ttys,
+ * "-" for stdin) is read into a heap buffer. Returns NULL if the file can not
+ * be read.
+ */
+struct source *source_open(const char *filename);
+void source_close(struct source *source);
+
+// Program text read in chunks, only what was not consumed yet is kept
+struct source_stream {
+	int fd;
+	char *data;
+	size_t length; // Bytes in data
+	size_t capacity;
+	bool eof; // Everything was read
+};
+
+struct source_stream *source_stream_open(const char *filename);
+
+/*
+ * Drops the first consumed bytes of data and reads after the rest. The
+ * buffer only grows when nothing could be dropped, it is then read until it
+ * is full so a long statement needs few passes. Returns false if reading
+ * failed.
+ */
+bool source_stream_fill(struct source_stream *stream, size_t consumed);
+void source_stream_close(struct source_stream *stream);
+
+#endif
@@ -0,0 +1,150 @@
+#include "error.h"
+#include "ast.h"
+#include "arena.h"
+#include "lexer.h"
+#include "parser.h"
+#include "resolver.h"
+#include "fold.h"
+#include "interpreter.h"
+#include "command.h"
+#include "output.h"
+#include "source.h"
+#include "stream.h"
+#include "string_heap.h"
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#define INITIAL_SLOTS 64
+
+struct stream_state {
+	struct source_stream *source;
+	struct lexer *lexer;
+	struct arena *arena; // Nodes of the statement that is running
+	struct resolver *resolver;
+	struct frame frame;
+	size_t consumed; // Bytes of source->data that already ran
+	struct source_pos pos; // Where the next statement starts
+};
+
+static void grow_frame(struct frame *frame, size_t slot_count)
+{
+	if (slot_count <= frame->slot_count) {
+		return;
+	}
+
+	size_t capacity = frame->slot_count * 2;
+	if (capacity < slot_count) {
+		capacity = slot_count;
+	}
+	frame->slots =
+		realloc(frame->slots, sizeof(*frame->slots) * capacity);
+	assert(frame->slots != NULL);
+	memset(frame->slots + frame->slot_count, 0,
+	       sizeof(*frame->slots) * (capacity - frame->slot_count));
+	frame->slot_count = capacity;
+}
+
+static enum EXT_CODE run_statement(struct stream_state *s,
+				   struct ast_node *statement)
+{
+	struct error *err = NULL;
+	resolver_resolve(s->resolver, statement, &err);
+	if (err == NULL) {
+		fold_statement(statement, &err);
+	}
+	if (err != NULL) {
+		error_print(err);
+		error_free(err);
+		return EXT_FAIL;
+	}
+	grow_frame(&s->frame, resolver_slot_count(s->resolver));
+
+	// Variables hold their own reference to strings of the statement
+	return interpret_statement(statement, &s->frame);
+}
+
+static void release_strings(struct frame *frame)
+{
+	for (size_t i = 0; i < frame->slot_count; ++i) {
+		value_release(frame->slots[i]);
+	}
+}
+
+static enum EXT_CODE run(struct stream_state *s, const char *filename)
+{
+	for (;;) {
+		struct arena_mark mark = arena_get_mark(s->arena);
+		lexer_rebase(s->lexer, s->source->data + s->consumed,
+			     s->source->length - s->consumed, s->pos.line,
+			     s->pos.column);
+
+		struct error *err = NULL;
+		struct ast_node *statement =
+			parse_statement(s->lexer, s->arena, &err);
+
+		// Reaching the end of the buffer may have cut the statement short
+		if (s->lexer->pos >= s->lexer->length && !s->source->eof) {
+			error_free(err);
+			arena_reset(s->arena, mark);
+
+			// Show what ran so far before waiting for more input
+			output_flush();
+			if (!source_stream_fill(s->source, s->consumed)) {
+				fprintf(stderr, "Could not read file '%s'\n",
+					filename);
+				return EXT_FAIL;
+			}
+			s->consumed = 0;
+			continue;
+		}
+
+		if (err != NULL) {
+			error_print(err);
+			error_free(err);
+			return EXT_FAIL;
+		}
+		if (statement->tok.type == TOKEN_EOF) {
+			return EXT_SUCCESS;
+		}
+
+		if (run_statement(s, statement) != EXT_SUCCESS) {
+			return EXT_FAIL;
+		}
+
+		s->consumed += s->lexer->pos;
+		s->pos = (struct source_pos){ s->lexer->line,
+					      s->lexer->column };
+		arena_reset(s->arena, mark);
+	}
+}
+
+enum EXT_CODE stream_run(const char *filename, struct command_base *cb)
+{
+	struct source_stream *source = source_stream_open(filename);
+	if (source == NULL) {
+		fprintf(stderr, "Could not read file '%s'\n", filename);
+		return EXT_FAIL;
+	}
+
+	struct stream_state s = {
+		.source = source,
+		.lexer = lexer_create(source->data, 0, cb),
+		.arena = arena_create(),
+		.resolver = resolver_create(0),
+		.frame = { .slots = NULL, .slot_count = 0 },
+		.consumed = 0,
+		.pos = { 1, 1 },
+	};
+	grow_frame(&s.frame, INITIAL_SLOTS);
+
+	enum EXT_CODE result = run(&s, filename);
+
+	release_strings(&s.frame);
+	free(s.frame.slots);
+	resolver_free(s.resolver);
+	arena_destroy(s.arena);
+	lexer_destroy(s.lexer);
+	source_stream_close(source);
+	return result;
+}
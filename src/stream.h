@@ -0,0 +1,16 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "interpreter.h"
+
+struct command_base;
+
+/*
+ * Reads, parses and runs one statement at a time, so memory does not grow
+ * with the length of the program and output starts right away. Runs on the
+ * AST walker. Unlike a whole program run, statements before a lexer error
+ * have already run when it is found.
+ */
+enum EXT_CODE stream_run(const char *filename, struct command_base *cb);
+
+#endif
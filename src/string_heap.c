@@ -0,0 +1,112 @@
+#include "string_heap.h"
+#include <string.h>
+#include <assert.h>
+
+#define INITIAL_BUCKETS 64
+
+static struct string **buckets = NULL;
+static size_t bucket_count = 0; // Power of two
+static size_t string_count = 0;
+
+static uint64_t hash_text(const char *text, size_t length)
+{
+	// FNV-1a
+	uint64_t hash = 0xCBF29CE484222325ull;
+	for (size_t i = 0; i < length; ++i) {
+		hash = (hash ^ (unsigned char)text[i]) * 0x100000001B3ull;
+	}
+	return hash;
+}
+
+static void grow_buckets()
+{
+	size_t new_count = bucket_count ? bucket_count * 2 : INITIAL_BUCKETS;
+	struct string **new_buckets = calloc(new_count, sizeof(*new_buckets));
+	assert(new_buckets != NULL);
+
+	for (size_t i = 0; i < bucket_count; ++i) {
+		struct string *str = buckets[i];
+		while (str != NULL) {
+			struct string *next = str->next;
+			struct string **bucket =
+				&new_buckets[str->hash & (new_count - 1)];
+			str->next = *bucket;
+			*bucket = str;
+			str = next;
+		}
+	}
+
+	free(buckets);
+	buckets = new_buckets;
+	bucket_count = new_count;
+}
+
+struct string *string_intern(const char *text, size_t length)
+{
+	uint64_t hash = hash_text(text, length);
+	if (bucket_count > 0) {
+		for (struct string *str = buckets[hash & (bucket_count - 1)];
+		     str != NULL; str = str->next) {
+			if (str->hash == hash && str->length == length &&
+			    memcmp(str->data, text, length) == 0) {
+				return string_retain(str);
+			}
+		}
+	}
+
+	// Keep chains short, one string per bucket on average
+	if (string_count >= bucket_count) {
+		grow_buckets();
+	}
+
+	assert(length <= UINT32_MAX);
+	struct string *str = malloc(sizeof(*str) + length + 1);
+	assert(str != NULL);
+	str->hash = hash;
+	str->refs = 1;
+	str->length = length;
+	memcpy(str->data, text, length);
+	str->data[length] = '\0';
+
+	struct string **bucket = &buckets[hash & (bucket_count - 1)];
+	str->next = *bucket;
+	*bucket = str;
+	++string_count;
+	return str;
+}
+
+struct string *string_retain(struct string *str)
+{
+	assert(str->refs < UINT32_MAX);
+	++str->refs;
+	return str;
+}
+
+void string_release(struct string *str)
+{
+	if (--str->refs > 0) {
+		return;
+	}
+
+	struct string **link = &buckets[str->hash & (bucket_count - 1)];
+	while (*link != str) {
+		link = &(*link)->next;
+	}
+	*link = str->next;
+	--string_count;
+	free(str);
+}
+
+void value_retain(struct value val)
+{
+	if (value_is_str(val)) {
+		string_retain(value_as_str(val));
+	}
+}
+
+void value_release(struct value val)
+{
+	if (value_is_str(val)) {
+		string_release(value_as_str(val));
+	}
+}
@@ -0,0 +1,32 @@
+#ifndef STRING_HEAP_H
+#define STRING_HEAP_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "value.h"
+
+/*
+ * Identifiers and string values are interned: equal text always gives the
+ * same string, so strings compare by pointer. Strings are immutable and
+ * reference counted, the last release frees them and takes them out of the
+ * heap again.
+ */
+struct string {
+	struct string *next; // Chain of the heap bucket
+	uint64_t hash;
+	uint32_t refs;
+	uint32_t length;
+	char data[]; // NUL terminated
+};
+
+// Returns a new reference, text does not need to be NUL terminated
+struct string *string_intern(const char *text, size_t length);
+struct string *string_retain(struct string *str);
+void string_release(struct string *str);
+
+// Take and drop the reference a value holds, if it is a string
+void value_retain(struct value val);
+void value_release(struct value val);
+
+#endif
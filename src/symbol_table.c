@@ -2,61 +2,81 @@
 #include "scope_table.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include "error.h"
 #include <assert.h>
 
+#define INITIAL_SCOPES_SIZE 4
+#define INITIAL_LOG_SIZE 256
+
 // Function to create and initialize the symbol table
-struct symbol_table *symbol_table_create(struct scope_table *global_scope)
+struct symbol_table *symbol_table_create(size_t size)
 {
 	struct symbol_table *table = malloc(sizeof(*table));
 	assert(table != NULL);
 
-	table->scopes = malloc(sizeof(struct scope_table *));
-	assert(table->scopes != NULL);
+	table->index = scope_table_create(size);
+
+	table->log = NULL;
+	table->log_length = 0;
+	table->log_allocated = 0;
 
-	table->scopes[0] = global_scope;
-	table->current_scope = global_scope;
-	table->allocated = 1;
+	table->scope_starts = malloc(sizeof(size_t) * INITIAL_SCOPES_SIZE);
+	assert(table->scope_starts != NULL);
+	table->allocated = INITIAL_SCOPES_SIZE;
 	table->length = 1;
 
 	return table;
 }
 
-// Function to resize the scopes stack
-static void resize_stack(struct symbol_table *table)
-{
-	size_t new_allocated = table->allocated * 2;
-	struct scope_table **new_stack = realloc(
-		table->scopes, sizeof(struct scope_table *) * new_allocated);
-	assert(new_stack != NULL);
-
-	table->scopes = new_stack;
-	table->allocated = new_allocated;
-}
-
 // Function to push a new scope onto the symbol table stack
-void symbol_table_push_scope(struct symbol_table *table,
-			     struct scope_table *scope)
+void symbol_table_push_scope(struct symbol_table *table)
 {
 	if (table->length >= table->allocated) {
-		resize_stack(table);
+		table->allocated *= 2;
+		table->scope_starts =
+			realloc(table->scope_starts,
+				sizeof(size_t) * table->allocated);
+		assert(table->scope_starts != NULL);
 	}
 
-	table->scopes[table->length] = scope;
-	table->current_scope = scope;
+	table->scope_starts[table->length] = table->log_length;
 	table->length++;
 }
 
-// Function to pop the current scope from the symbol table stack
+// Unbinds every name the current scope logged
 void symbol_table_pop_scope(struct symbol_table *table)
 {
 	if (table->length <= 1) {
 		return; // Prevent popping the global scope
 	}
 
-	scope_table_free(table->current_scope);
 	table->length--;
-	table->current_scope = table->scopes[table->length - 1];
+	size_t start = table->scope_starts[table->length];
+	for (size_t i = start; i < table->log_length;
+	     i += strlen(table->log + i) + 1) {
+		scope_table_delete(table->index, table->log + i);
+	}
+	table->log_length = start;
+}
+
+static void log_name(struct symbol_table *table, const char *identifier)
+{
+	size_t len = strlen(identifier) + 1;
+	if (table->log_length + len > table->log_allocated) {
+		size_t allocated = table->log_allocated > 0 ?
+					   table->log_allocated :
+					   INITIAL_LOG_SIZE;
+		while (table->log_length + len > allocated) {
+			allocated *= 2;
+		}
+		table->log = realloc(table->log, allocated);
+		assert(table->log != NULL);
+		table->log_allocated = allocated;
+	}
+
+	memcpy(table->log + table->log_length, identifier, len);
+	table->log_length += len;
 }
 
 // Function to find a symbol in the symbol table
@@ -65,28 +85,21 @@ struct symbol *symbol_table_find(const struct symbol_table *table,
 				 struct symbol_call_data call_data,
 				 struct error **err)
 {
-	struct scope_table *active_scope = table->current_scope;
-
 	struct symbol *found_symbol =
-		scope_table_find(active_scope, identifier, call_data, err);
-
-	while (found_symbol == NULL) {
-		if (active_scope->parent == NULL) {
-			*err = error_create(
-				ERROR_INTERPRETER, ERROR_INVALID_IDENTIFIER,
-				call_data.line, call_data.column,
-				"No variable found with identifier '%s'",
-				identifier);
-			return NULL;
-		}
-		active_scope = active_scope->parent;
+		scope_table_find(table->index, identifier, call_data, NULL);
+	if (found_symbol != NULL) {
+		return found_symbol;
 	}
 
-	return found_symbol;
+	*err = error_create(ERROR_INTERPRETER, ERROR_INVALID_IDENTIFIER,
+			    call_data.line, call_data.column,
+			    "No variable found with identifier '%s'",
+			    identifier);
+	return NULL;
 }
 
 void symbol_table_change(struct symbol_table *table, const char *identifier,
-			 union symbol_val new_value,
+			 struct value new_value,
 			 struct symbol_call_data call_data, struct error **err)
 {
 	struct symbol *sym =
@@ -100,34 +113,33 @@ void symbol_table_change(struct symbol_table *table, const char *identifier,
 }
 
 void symbol_table_insert(struct symbol_table *table, const char *identifier,
-			 enum SYMBOL_TYPE type, union symbol_val value,
+			 struct value value,
 			 struct symbol_call_data call_data, struct error **err)
 {
-	scope_table_insert(table->current_scope, identifier, type, value,
-			   call_data, err);
+	// The index holds every open scope, so this also rejects outer names
+	scope_table_insert(table->index, identifier, value, call_data, err);
+	if (*err == NULL && table->length > 1) {
+		log_name(table, identifier);
+	}
 }
 
+// Identifiers have a single binding, it is removed from whichever scope
 void symbol_table_delete(struct symbol_table *table, const char *identifier)
 {
-	scope_table_delete(table->current_scope, identifier);
+	scope_table_delete(table->index, identifier);
 }
 
 // Function to free all memory associated with the symbol table
 void symbol_table_free(struct symbol_table *table)
 {
-	for (size_t i = 0; i < table->length; i++) {
-		scope_table_free(table->scopes[i]);
-	}
-
-	free(table->scopes);
+	scope_table_free(table->index);
+	free(table->log);
+	free(table->scope_starts);
 	free(table);
 }
 
 void symbol_table_print(const struct symbol_table *table)
 {
-	printf("Symbol Table:\n");
-	for (size_t i = 0; i < table->length; i++) {
-		printf("Scope %zu:\n", i);
-		scope_table_print(table->scopes[i]);
-	}
+	printf("Symbol Table: %zu scopes\n", table->length);
+	scope_table_print(table->index);
 }
@@ -4,27 +4,39 @@
 #include <stdlib.h>
 #include "scope_table.h"
 
+/*
+ * Identifiers can not be shadowed, so every visible binding of every open
+ * scope lives in one index and a lookup or duplicate check is one probe no
+ * matter how deep the scopes are nested. Names bound by inner scopes are
+ * also appended to an undo log, popping a scope unbinds everything logged
+ * since it was pushed. The global scope is never popped and not logged.
+ */
 struct symbol_table {
-	struct scope_table **scopes;
-	struct scope_table *current_scope;
-	size_t allocated; // Allocated space to use in stack
-	size_t length; // Count of scopes in stack
+	struct scope_table *index;
+
+	char *log; // NUL terminated names, newest last
+	size_t log_length;
+	size_t log_allocated;
+
+	size_t *scope_starts; // log_length when each inner scope was pushed
+	size_t allocated; // Allocated space to use in scope_starts
+	size_t length; // Count of scopes, the global one included
 };
 
-struct symbol_table *symbol_table_create(struct scope_table *global_scope);
+// size is a hint of how many identifiers the global scope will hold
+struct symbol_table *symbol_table_create(size_t size);
 
-void symbol_table_push_scope(struct symbol_table *table,
-			     struct scope_table *scope);
+void symbol_table_push_scope(struct symbol_table *table);
 void symbol_table_pop_scope(struct symbol_table *table);
 struct symbol *symbol_table_find(const struct symbol_table *table,
 				 const char *identifier,
 				 struct symbol_call_data call_data,
 				 struct error **err);
 void symbol_table_change(struct symbol_table *table, const char *identifier,
-			 union symbol_val new_value,
+			 struct value new_value,
 			 struct symbol_call_data call_data, struct error **err);
 void symbol_table_insert(struct symbol_table *table, const char *identifier,
-			 enum SYMBOL_TYPE type, union symbol_val value,
+			 struct value value,
 			 struct symbol_call_data call_data, struct error **err);
 void symbol_table_delete(struct symbol_table *table, const char *identifier);
 
@@ -0,0 +1,144 @@
+#include "error.h"
+#include "ast.h"
+#include "command_funcs.h"
+#include "resolver.h"
+#include "types.h"
+#include <assert.h>
+
+struct inference {
+	enum VALUE_TYPE *slots; // Type of each variable
+	bool may_fail; // An operation of the statement may fail at runtime
+	bool deferred; // Types are only known while running from here on
+};
+
+static void infer_node(struct inference *inf, struct ast_node *node,
+		       struct error **err);
+
+void infer_types(struct ast_node *ast, struct resolution *res)
+{
+	struct inference inf = {
+		.slots = malloc(sizeof(enum VALUE_TYPE) *
+				(res->slot_count + 1)),
+		.may_fail = false,
+		.deferred = false,
+	};
+	assert(inf.slots != NULL);
+	for (size_t i = 0; i < res->slot_count; ++i) {
+		inf.slots[i] = VALUE_ANY;
+	}
+
+	for (size_t i = 0; i < res->statement_count && !inf.deferred; ++i) {
+		struct ast_walk walk;
+		ast_walk_init(&walk, ast->args[i]);
+
+		struct error *err = NULL;
+		struct ast_node *node;
+		inf.may_fail = false;
+		while (err == NULL && !inf.deferred &&
+		       (node = ast_walk_next(&walk)) != NULL) {
+			infer_node(&inf, node, &err);
+		}
+
+		ast_walk_free(&walk);
+		if (err != NULL) {
+			// Fails before the error found so far, if any
+			error_free(res->err);
+			res->err = err;
+			res->statement_count = i;
+		}
+	}
+
+	free(inf.slots);
+}
+
+// A statement that may fail before its type error has to run to find out
+static void type_error(struct inference *inf, const struct ast_node *node,
+		       const char *message, struct error **err)
+{
+	if (inf->may_fail) {
+		inf->deferred = true;
+		return;
+	}
+	*err = error_create(ERROR_INTERPRETER, ERROR_RUNTIME_ERROR,
+			    node->pos.line, node->pos.column, "%s", message);
+}
+
+static bool nonzero_constant(const struct ast_node *node)
+{
+	if (node->tok.type == TOKEN_INT) {
+		return node->tok.int_val != 0;
+	}
+	return node->tok.type == TOKEN_CONSTANT &&
+	       value_as_int(node->result) != 0;
+}
+
+static void infer_subcommand(struct inference *inf, struct ast_node *node,
+			     struct error **err)
+{
+	enum VALUE_TYPE x = node->args[0]->type;
+	enum VALUE_TYPE y = node->args[1]->type;
+	if (x == VALUE_STR || y == VALUE_STR) {
+		type_error(inf, node, "Can not do arithmetic on a string", err);
+		return;
+	}
+	if (x == VALUE_ANY || y == VALUE_ANY) {
+		return;
+	}
+
+	if (x == VALUE_INT && y == VALUE_INT) {
+		node->type = VALUE_INT;
+		if (node->func == subcommand_func_div &&
+		    !nonzero_constant(node->args[1])) {
+			inf->may_fail = true;
+		}
+	} else {
+		node->type = VALUE_DOUBLE;
+	}
+}
+
+static void infer_node(struct inference *inf, struct ast_node *node,
+		       struct error **err)
+{
+	switch (node->tok.type) {
+	case TOKEN_INT:
+		node->type = VALUE_INT;
+		return;
+	case TOKEN_DOUBLE:
+		node->type = VALUE_DOUBLE;
+		return;
+	case TOKEN_STR:
+		node->type = VALUE_STR;
+		return;
+	case TOKEN_CONSTANT:
+		node->type = value_is_int(node->result) ? VALUE_INT :
+							  VALUE_DOUBLE;
+		return;
+	case TOKEN_IDENTIFIER:
+		// The identifier of a CREATE is typed by the CREATE
+		node->type = inf->slots[node->slot];
+		return;
+	case TOKEN_SUBCOMMAND:
+		if (node->argc == 2) {
+			infer_subcommand(inf, node, err);
+		}
+		return;
+	default:
+		break;
+	}
+
+	enum VALUE_TYPE value = node->argc == 2 ? node->args[1]->type :
+						   VALUE_ANY;
+	if (node->func == command_func_create) {
+		inf->slots[node->args[0]->slot] = value;
+		node->args[0]->type = value;
+	} else if (node->func == command_func_set) {
+		enum VALUE_TYPE var = node->args[0]->type;
+		if (var != VALUE_ANY && value != VALUE_ANY &&
+		    (var == VALUE_STR) != (value == VALUE_STR)) {
+			type_error(
+				inf, node,
+				"Can not assign a value of a different type to a variable",
+				err);
+		}
+	}
+}
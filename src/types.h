@@ -0,0 +1,18 @@
+#ifndef TYPES_H
+#define TYPES_H
+
+struct ast_node;
+struct resolution;
+
+/*
+ * Sets the static type of every value of a resolved and folded program. A
+ * variable keeps the type it was created with, so every operand and result
+ * type is known without running. Arithmetic on a string and assigning a
+ * string to a number or back become the error of the resolution, raised
+ * when their statement is reached. If something in the statement may fail
+ * first, a division by a variable, the statement and everything after it
+ * keep VALUE_ANY and are checked while running instead.
+ */
+void infer_types(struct ast_node *ast, struct resolution *res);
+
+#endif
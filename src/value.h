@@ -0,0 +1,108 @@
+#ifndef VALUE_H
+#define VALUE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+
+struct string;
+
+/*
+ * Every value is 8 bytes, NaN-boxed. A double is stored as it is, NaNs are
+ * reduced to the quiet NaN of the same sign. That leaves every top 16 bits
+ * above 0xFFF8 unused by doubles, two of them tag an int or a string
+ * pointer kept in the low 48 bits. The type of a value is a test of its
+ * bits, there is no separate tag to load.
+ */
+struct value {
+	uint64_t bits;
+};
+
+#define VALUE_TAG_SHIFT 48
+#define VALUE_TAG_INT 0xFFF9ull
+#define VALUE_TAG_STR 0xFFFAull
+#define VALUE_PAYLOAD_MASK ((1ull << VALUE_TAG_SHIFT) - 1)
+#define VALUE_SIGN_BIT 0x8000000000000000ull
+#define VALUE_QUIET_NAN 0x7FF8000000000000ull
+
+// Type of a value known before running, VALUE_ANY if only running tells
+enum VALUE_TYPE { VALUE_INT, VALUE_DOUBLE, VALUE_STR, VALUE_ANY };
+
+static inline struct value value_int(int x)
+{
+	return (struct value){ VALUE_TAG_INT << VALUE_TAG_SHIFT |
+			       (uint32_t)x };
+}
+
+static inline struct value value_double(double x)
+{
+	uint64_t bits;
+	memcpy(&bits, &x, sizeof(bits));
+	if (x != x) {
+		bits = (bits & VALUE_SIGN_BIT) | VALUE_QUIET_NAN;
+	}
+	return (struct value){ bits };
+}
+
+// Pointers of user space fit in 48 bits on every 64 bit target we run on
+static inline struct value value_str(struct string *str)
+{
+	assert(((uintptr_t)str & ~VALUE_PAYLOAD_MASK) == 0);
+	return (struct value){ VALUE_TAG_STR << VALUE_TAG_SHIFT |
+			       (uintptr_t)str };
+}
+
+static inline bool value_is_int(struct value x)
+{
+	return x.bits >> VALUE_TAG_SHIFT == VALUE_TAG_INT;
+}
+
+static inline bool value_is_str(struct value x)
+{
+	return x.bits >> VALUE_TAG_SHIFT == VALUE_TAG_STR;
+}
+
+static inline bool value_is_double(struct value x)
+{
+	return x.bits < VALUE_TAG_INT << VALUE_TAG_SHIFT;
+}
+
+// Ints and doubles, the only tagged values left are strings
+static inline bool value_is_num(struct value x)
+{
+	return !value_is_str(x);
+}
+
+// The tag bits of both survive the AND only if both are ints
+static inline bool value_both_int(struct value x, struct value y)
+{
+	return (x.bits & y.bits) >> VALUE_TAG_SHIFT == VALUE_TAG_INT;
+}
+
+static inline bool value_same_type(struct value x, struct value y)
+{
+	if (value_is_double(x)) {
+		return value_is_double(y);
+	}
+	return x.bits >> VALUE_TAG_SHIFT == y.bits >> VALUE_TAG_SHIFT;
+}
+
+static inline int value_as_int(struct value x)
+{
+	return (int)(uint32_t)x.bits;
+}
+
+static inline double value_as_double(struct value x)
+{
+	double d;
+	memcpy(&d, &x.bits, sizeof(d));
+	return d;
+}
+
+static inline struct string *value_as_str(struct value x)
+{
+	return (struct string *)(uintptr_t)(x.bits & VALUE_PAYLOAD_MASK);
+}
+
+#endif
@@ -0,0 +1,236 @@
+#include "error.h"
+#include "bytecode.h"
+#include "vm.h"
+#include "command.h"
+#include "arithmetic.h"
+#include "output.h"
+#include "string_heap.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <assert.h>
+
+bool vm_assign(struct value *slot, struct value val)
+{
+	if (value_same_type(*slot, val)) {
+		// Retained first, the slot may already hold the same string
+		value_retain(val);
+		value_release(*slot);
+		*slot = val;
+		return true;
+	}
+	if (!arith_is_num(*slot) || !arith_is_num(val)) {
+		return false;
+	}
+
+	if (value_is_int(*slot)) {
+		*slot = value_int(arith_to_int(value_as_double(val)));
+	} else {
+		*slot = value_double((double)value_as_int(val));
+	}
+	return true;
+}
+
+bool vm_call(const struct chunk *chunk, struct value *slots, uint32_t index)
+{
+	struct frame frame = { .slots = slots,
+			       .slot_count = chunk->slot_count };
+	return interpret_statement(chunk->nodes[index], &frame) ==
+	       EXT_SUCCESS;
+}
+
+enum EXT_CODE vm_run(const struct chunk *const chunk)
+{
+	static const void *const dispatch[] = {
+		[OP_CONST] = &&op_const, [OP_LOAD] = &&op_load,
+		[OP_CREATE] = &&op_create, [OP_SET] = &&op_set,
+		[OP_PRINT] = &&op_print, [OP_ADD] = &&op_add,
+		[OP_SUB] = &&op_sub, [OP_MUL] = &&op_mul,
+		[OP_DIV] = &&op_div, [OP_ADD_INT] = &&op_add_int,
+		[OP_SUB_INT] = &&op_sub_int, [OP_MUL_INT] = &&op_mul_int,
+		[OP_DIV_INT] = &&op_div_int, [OP_ADD_DOUBLE] = &&op_add_double,
+		[OP_SUB_DOUBLE] = &&op_sub_double,
+		[OP_MUL_DOUBLE] = &&op_mul_double,
+		[OP_DIV_DOUBLE] = &&op_div_double,
+		[OP_TO_DOUBLE] = &&op_to_double, [OP_TO_INT] = &&op_to_int,
+		[OP_STORE] = &&op_store, [OP_CALL] = &&op_call,
+		[OP_FAIL] = &&op_fail,
+		[OP_HALT] = &&op_halt,
+	};
+
+	struct value *slots =
+		calloc(chunk->slot_count + 1, sizeof(struct value));
+	assert(slots != NULL);
+
+	struct value *stack =
+		malloc((chunk->max_stack + 1) * sizeof(struct value));
+	assert(stack != NULL);
+
+	const struct instruction *ip = chunk->code;
+	struct value *sp = stack;
+	struct error *err = NULL;
+	enum EXT_CODE result = EXT_SUCCESS;
+
+#define DISPATCH() goto *dispatch[ip->op]
+#define NEXT()              \
+	do {                \
+		++ip;       \
+		DISPATCH(); \
+	} while (0)
+#define ARITHMETIC(int_expr, double_op)                                 \
+	do {                                                            \
+		struct value *x = sp - 2;                               \
+		struct value y = sp[-1];                                \
+		if (arith_is_int(*x, y)) {                              \
+			int a = value_as_int(*x);                       \
+			int b = value_as_int(y);                        \
+			*x = value_int(int_expr);                       \
+		} else if (arith_is_num(*x) && arith_is_num(y)) {       \
+			*x = value_double(arith_to_double(*x)           \
+				double_op arith_to_double(y));          \
+		} else {                                                \
+			goto string_arithmetic;                         \
+		}                                                       \
+		--sp;                                                   \
+	} while (0)
+// The compiler proved the types, nothing is checked
+#define INT_ARITHMETIC(int_expr)                        \
+	do {                                            \
+		int a = value_as_int(sp[-2]);           \
+		int b = value_as_int(sp[-1]);           \
+		sp[-2] = value_int(int_expr);           \
+		--sp;                                   \
+	} while (0)
+#define DOUBLE_ARITHMETIC(double_op)                            \
+	do {                                                    \
+		sp[-2] = value_double(value_as_double(sp[-2])   \
+			double_op value_as_double(sp[-1]));     \
+		--sp;                                           \
+	} while (0)
+
+	DISPATCH();
+
+op_const:
+	*sp++ = chunk->constants[ip->arg];
+	NEXT();
+op_load:
+	*sp++ = slots[ip->arg];
+	NEXT();
+op_create:
+	slots[ip->arg] = *--sp;
+	value_retain(slots[ip->arg]);
+	NEXT();
+op_set:
+	if (!vm_assign(&slots[ip->arg], *--sp)) {
+		err = error_create(
+			ERROR_INTERPRETER, ERROR_RUNTIME_ERROR,
+			chunk->positions[ip - chunk->code].line,
+			chunk->positions[ip - chunk->code].column,
+			"Can not assign a value of a different type to a variable");
+		goto fail;
+	}
+	NEXT();
+op_print:
+	output_value(*--sp);
+	output_char('\n');
+	NEXT();
+op_add:
+	ARITHMETIC(arith_int_add(a, b), +);
+	NEXT();
+op_sub:
+	ARITHMETIC(arith_int_sub(a, b), -);
+	NEXT();
+op_mul:
+	ARITHMETIC(arith_int_mul(a, b), *);
+	NEXT();
+op_div:
+	if (arith_is_int(sp[-2], sp[-1]) && value_as_int(sp[-1]) == 0) {
+		err = error_create(ERROR_INTERPRETER, ERROR_RUNTIME_ERROR,
+				   chunk->positions[ip - chunk->code].line,
+				   chunk->positions[ip - chunk->code].column,
+				   "Division by zero");
+		goto fail;
+	}
+	ARITHMETIC(arith_int_div(a, b), /);
+	NEXT();
+
+op_add_int:
+	INT_ARITHMETIC(arith_int_add(a, b));
+	NEXT();
+op_sub_int:
+	INT_ARITHMETIC(arith_int_sub(a, b));
+	NEXT();
+op_mul_int:
+	INT_ARITHMETIC(arith_int_mul(a, b));
+	NEXT();
+op_div_int:
+	if (value_as_int(sp[-1]) == 0) {
+		err = error_create(ERROR_INTERPRETER, ERROR_RUNTIME_ERROR,
+				   chunk->positions[ip - chunk->code].line,
+				   chunk->positions[ip - chunk->code].column,
+				   "Division by zero");
+		goto fail;
+	}
+	INT_ARITHMETIC(arith_int_div(a, b));
+	NEXT();
+op_add_double:
+	DOUBLE_ARITHMETIC(+);
+	NEXT();
+op_sub_double:
+	DOUBLE_ARITHMETIC(-);
+	NEXT();
+op_mul_double:
+	DOUBLE_ARITHMETIC(*);
+	NEXT();
+op_div_double:
+	DOUBLE_ARITHMETIC(/);
+	NEXT();
+op_to_double:
+	sp[-1] = value_double((double)value_as_int(sp[-1]));
+	NEXT();
+op_to_int:
+	sp[-1] = value_int(arith_to_int(value_as_double(sp[-1])));
+	NEXT();
+op_store:
+	slots[ip->arg] = *--sp;
+	NEXT();
+
+op_call:
+	if (!vm_call(chunk, slots, ip->arg)) {
+		result = EXT_FAIL;
+		goto done;
+	}
+	NEXT();
+
+string_arithmetic:
+	err = error_create(ERROR_INTERPRETER, ERROR_RUNTIME_ERROR,
+			   chunk->positions[ip - chunk->code].line,
+			   chunk->positions[ip - chunk->code].column,
+			   "Can not do arithmetic on a string");
+	goto fail;
+
+op_fail:
+	error_print(chunk->err);
+	result = EXT_FAIL;
+	goto done;
+
+fail:
+	error_print(err);
+	error_free(err);
+	result = EXT_FAIL;
+	goto done;
+
+op_halt:
+done:
+#undef DOUBLE_ARITHMETIC
+#undef INT_ARITHMETIC
+#undef ARITHMETIC
+#undef NEXT
+#undef DISPATCH
+	free(stack);
+	for (size_t i = 0; i < chunk->slot_count; ++i) {
+		value_release(slots[i]);
+	}
+	free(slots);
+	return result;
+}
@@ -0,0 +1,18 @@
+#ifndef VM_H
+#define VM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "interpreter.h"
+
+struct chunk;
+struct value;
+
+enum EXT_CODE vm_run(const struct chunk *const chunk);
+
+// What OP_SET does, false if the value can not take the type of the slot
+bool vm_assign(struct value *slot, struct value val);
+// What OP_CALL does, errors are printed and give false
+bool vm_call(const struct chunk *chunk, struct value *slots, uint32_t index);
+
+#endif